@@ -5,11 +5,20 @@
 #include <string>
 #include <algorithm>
 #include <cstdint>
+#include <limits>
+#include <mutex>
+#include <memory>
 
 #include <Escape.hpp>
 #include <PatchData.hpp>
-#include "../ARPatcher/Utilities.hpp"
-#include "../ARPatcher/Patch.hpp"
+#include "Utilities.hpp"
+#include "Patch.hpp"
+#include "MappedPatch.hpp"
+#include "MemoryBudgetScheduler.hpp"
+#include "IndexFile.hpp"
+#include "Instrumentation.hpp"
+#include "InPlacePatch.hpp"
+#include "StreamingPatch.hpp"
 
 void printUsage()
 {
@@ -18,12 +27,259 @@ void printUsage()
 		<< "ARPatchApplier <index file name>\n\n";
 	std::cerr << "Build multiple new files from old files and index files:\n"
 		<< "ARPatchApplier <index file name 1> <index file name 2> <index file name 3>...\n\n";
+	std::cerr << "Options:\n"
+		<< "-mapped: memory map the old files instead of reading them into memory;\n"
+		<< "\tmemory usage stays low regardless of the file sizes\n"
+		<< "-jobs <job count>: apply up to <job count> index files at the same time (0 means one per CPU core)\n"
+		<< "-threads <thread count>: rebuild different parts of each new file on multiple threads (0 means one per CPU core)\n"
+		<< "-memoryBudget <MiB>: only start another index file if the estimated memory usage of all running ones\n"
+		<< "\tstays below this limit (default: half of the physical memory)\n"
+		<< "-inPlace: transform the old file into the new file, without writing a second copy of it;\n"
+		<< "\tthe old file is lost if this is interrupted, and index files without checksums are rejected.\n"
+		<< "\tUp to -memoryBudget bytes of the old file may be kept in memory to break copy cycles\n"
+		<< "-statsJson <file name>: write the time spent in every phase and the hot path counters to a JSON file\n\n";
 	std::cerr << std::endl;
 	std::cerr << "Surround file names with quotes (\") when they contain spaces." << std::endl;
 	std::cerr << "Press Enter to exit." << std::endl;
 	std::cin.get();
 }
 
+// Estimated peak memory usage of applying an index file
+std::size_t estimateApplyMemory(const std::filesystem::path& indexFileName, bool mapped, std::size_t threadCount, std::size_t bufferSize)
+{
+	auto reader = IndexFileReader{ indexFileName };
+	auto oldFileSize = static_cast<std::size_t>(std::filesystem::file_size(indexFileName.parent_path() / reader.patchData().oldFileName));
+	for (const auto& referenceFileName : reader.patchData().referenceFileNames)
+	{
+		oldFileSize += static_cast<std::size_t>(std::filesystem::file_size(indexFileName.parent_path() / referenceFileName));
+	}
+	// Output buffer and escape rank index
+	auto cost = bufferSize + oldFileSize / 128;
+	if (mapped == false)
+	{
+		cost += oldFileSize;
+	}
+	if (reader.columnarChunks() != nullptr)
+	{
+		// Columnar index files are used directly from the mapped file
+		return cost;
+	}
+	if (reader.chunksLoaded() == false && threadCount == 1)
+	{
+		// Compact index files are decoded one frame at a time
+		return cost + 2 * (CompactChunkWriter::maxFrameHeadersSize + CompactChunkWriter::maxFrameLiteralsSize);
+	}
+	while (const auto* chunk = reader.nextChunk())
+	{
+		cost += sizeof(WideDataChunk) + chunk->data.size();
+	}
+	return cost;
+}
+
+struct ApplyOptions
+{
+	bool mapped = false;
+	std::size_t threadCount = 1;
+	std::size_t bufferSize = 0;
+	bool inPlace = false;
+	// Largest amount of old file data kept in memory by in place patching
+	std::size_t maxSpillSize = 0;
+};
+
+// Transforms the old file into the new file, and renames it if the new file has another name
+template<typename ShowProgress, typename Log>
+void applyIndexFileInPlace(IndexFileReader& reader,
+	const std::vector<std::filesystem::path>& inputFileNames,
+	const std::filesystem::path& outputFileName,
+	const ApplyOptions& options,
+	ShowProgress showProgress,
+	Log log)
+{
+	const auto& patchData = reader.patchData();
+	const auto& checksums = reader.checksums();
+	if (checksums.has_value() == false)
+	{
+		throw std::runtime_error{ "Index files without checksums can't be applied in place, the old file couldn't be validated" };
+	}
+
+	auto schedule = InPlaceSchedule{};
+	// Reference files stay mapped, external operations read from them
+	auto mappedFiles = std::vector<std::unique_ptr<MappedFile>>{};
+	{
+		auto oldFiles = std::vector<SourceFile>{};
+		for (const auto& inputFileName : inputFileNames)
+		{
+			mappedFiles.push_back(std::make_unique<MappedFile>(inputFileName));
+			oldFiles.push_back(SourceFile{ mappedFiles.back()->data(), mappedFiles.back()->size() });
+		}
+		measurePhase("checkOldFile", [&]() {
+			checkOldFile(*checksums, oldFiles.front().data, oldFiles.front().size);
+			for (auto i = std::size_t{ 1 }; i < oldFiles.size(); ++i)
+			{
+				checkReferenceFile(*checksums, i - 1, oldFiles[i].data, oldFiles[i].size);
+			}
+		});
+		schedule = measurePhase("planInPlace", [&]() {
+			if (const auto* columnarChunks = reader.columnarChunks())
+			{
+				auto cursor = columnarChunks->cursor(0);
+				return planInPlacePatch(oldFiles, patchData.escapeData, [&cursor]() { return cursor.next(); }, options.maxSpillSize);
+			}
+			return planInPlacePatch(oldFiles, patchData.escapeData, [&reader]() { return reader.nextChunk(); }, options.maxSpillSize);
+		});
+		// The old file can't stay mapped while it's modified
+		mappedFiles.front().reset();
+	}
+	if (schedule.newFileSize() != checksums->newFileSize)
+	{
+		throw std::runtime_error{ "The index file doesn't build a new file of the expected size, corrupted index file?" };
+	}
+	log("Patching " + inputFileNames.front().string() + " in place (" + std::to_string(schedule.getOperations().size()) + " operations, "
+		+ std::to_string(schedule.spilledBytes()) + " bytes kept in memory)...");
+
+	measurePhase("writeNewFile", [&]() { applyInPlace(inputFileNames.front(), schedule, options.bufferSize, showProgress); });
+	measurePhase("checkNewFile", [&]() {
+		auto newFile = MappedFile{ inputFileNames.front() };
+		if (newFile.size() != checksums->newFileSize || hash64(newFile) != checksums->newFileHash)
+		{
+			throw std::runtime_error{ "New file checksum mismatch after patching " + inputFileNames.front().string() + " in place, it has to be restored" };
+		}
+	});
+	if (std::filesystem::exists(outputFileName) == false || std::filesystem::equivalent(inputFileNames.front(), outputFileName) == false)
+	{
+		std::filesystem::rename(inputFileNames.front(), outputFileName);
+	}
+}
+
+template<typename Log>
+void applyIndexFile(const std::filesystem::path& indexFileName, const ApplyOptions& options, bool showProgress, Log log)
+{
+	const auto mapped = options.mapped;
+	const auto threadCount = options.inPlace ? 1 : options.threadCount;
+	const auto bufferSize = options.bufferSize;
+	try
+	{
+		log("Reading index file " + indexFileName.string() + "...");
+		auto reader = measurePhase("readIndexFile", [&indexFileName]() { return IndexFileReader{ indexFileName }; });
+		const auto* columnarChunks = reader.columnarChunks();
+		// Sequential apply decodes the chunks of compact index files while writing the new file,
+		// columnar index files are always used as they are, and everything else needs all the chunks
+		if (threadCount != 1 && columnarChunks == nullptr)
+		{
+			measurePhase("readIndexFile", [&reader]() { reader.readAllChunks(); });
+		}
+		const auto& patchData = reader.patchData();
+		const auto& checksums = reader.checksums();
+		auto indexFileDirectory = indexFileName.parent_path();
+		auto inputFileNames = std::vector<std::filesystem::path>{ indexFileDirectory / patchData.oldFileName };
+		for (const auto& referenceFileName : patchData.referenceFileNames)
+		{
+			inputFileNames.push_back(indexFileDirectory / referenceFileName);
+		}
+		auto outputFileName = indexFileDirectory / patchData.newFileName;
+		auto inputFileList = std::string{};
+		for (const auto& inputFileName : inputFileNames)
+		{
+			inputFileList += (inputFileList.empty() ? "[" : ", [") + inputFileName.string() + "]";
+		}
+		log("Index file read, trying to create new file [" + outputFileName.string() + "] from " + inputFileList + "...");
+
+		auto expectedSum = static_cast<std::size_t>(reader.escapedNewFileSize());
+		auto printProgress = [showProgress, expectedSum, progress = std::size_t{ 0 }](std::size_t delta) mutable {
+			progress += delta;
+			if (showProgress)
+			{
+				std::cerr << makeMetricPrefix(progress) << "B (" << makePercent(progress, expectedSum) << ")          \r";
+			}
+		};
+		if (options.inPlace)
+		{
+			applyIndexFileInPlace(reader, inputFileNames, outputFileName, options, printProgress, log);
+			log("Successfully created file " + outputFileName.string() + ".      ");
+			return;
+		}
+		auto writeNewFile = [&](const std::vector<SourceFile>& oldFiles) {
+			if (checksums.has_value() == false)
+			{
+				log("Index file " + indexFileName.string() + " doesn't contain checksums, the old file and the new file won't be validated");
+			}
+			if (threadCount == 1)
+			{
+				// Same as any other user of the library, which also validates the old files and the new file
+				auto sources = std::vector<MemoryViewSource>{};
+				auto sourcePointers = std::vector<const PatchSource*>{};
+				for (const auto& oldFile : oldFiles)
+				{
+					sources.emplace_back(oldFile.data, oldFile.size);
+				}
+				for (const auto& source : sources)
+				{
+					sourcePointers.push_back(&source);
+				}
+				auto sink = FileSink{ outputFileName };
+				auto callbacks = PatchCallbacks{};
+				callbacks.progress = [showProgress](std::uint64_t written, std::uint64_t expected) {
+					if (showProgress)
+					{
+						std::cerr << makeMetricPrefix(written) << "B (" << makePercent(written, expected) << ")          \r";
+					}
+				};
+				const auto phase = ScopedPhase{ "writeNewFile" };
+				applyPatch(reader, sourcePointers, sink, callbacks, bufferSize);
+				return;
+			}
+
+			if (checksums.has_value())
+			{
+				measurePhase("checkOldFile", [&]() {
+					checkOldFile(*checksums, oldFiles.front().data, oldFiles.front().size);
+					for (auto i = std::size_t{ 1 }; i < oldFiles.size(); ++i)
+					{
+						checkReferenceFile(*checksums, i - 1, oldFiles[i].data, oldFiles[i].size);
+					}
+				});
+			}
+			const auto phase = ScopedPhase{ "writeNewFile" };
+			auto pool = WorkStealingPool{ threadCount };
+			const auto* checksumsPointer = checksums.has_value() ? &*checksums : nullptr;
+			if (columnarChunks != nullptr)
+			{
+				writeChunksFromRawInParallel(outputFileName, oldFiles, patchData.escapeData, *columnarChunks, bufferSize, pool,
+					checksumsPointer, printProgress);
+				return;
+			}
+			writeChunksFromRawInParallel(outputFileName, oldFiles, patchData.escapeData, DataChunkList{ patchData.dataChunks }, bufferSize, pool,
+				checksumsPointer, printProgress);
+		};
+		auto oldFiles = std::vector<SourceFile>{};
+		if (mapped)
+		{
+			auto mappedFiles = std::vector<std::unique_ptr<MappedFile>>{};
+			for (const auto& inputFileName : inputFileNames)
+			{
+				mappedFiles.push_back(std::make_unique<MappedFile>(inputFileName));
+				oldFiles.push_back(SourceFile{ mappedFiles.back()->data(), mappedFiles.back()->size() });
+			}
+			writeNewFile(oldFiles);
+		}
+		else
+		{
+			auto readFiles = std::vector<std::vector<std::uint8_t>>{};
+			for (const auto& inputFileName : inputFileNames)
+			{
+				readFiles.push_back(readEntireFile<std::uint8_t>(inputFileName));
+				oldFiles.push_back(SourceFile{ readFiles.back().data(), readFiles.back().size() });
+			}
+			writeNewFile(oldFiles);
+		}
+		log("Successfully created file " + outputFileName.string() + ".      ");
+	}
+	catch (const std::exception& e)
+	{
+		log("ERROR: " + indexFileName.string() + ": " + e.what() + "\nThis index file will be skipped.");
+	}
+}
+
 int main(int argc, char* argv[])
 {
 	try
@@ -44,39 +300,62 @@ int main(int argc, char* argv[])
 		}
 		std::cerr << std::endl;
 
+		auto mapped = extractFlag(arguments, "-mapped");
+		auto inPlace = extractFlag(arguments, "-inPlace");
+		auto statsJsonFileName = extractOption(arguments, "-statsJson");
+		auto jobCount = std::size_t{ 1 };
+		if (auto jobs = extractOption(arguments, "-jobs"))
+		{
+			jobCount = std::stoul(*jobs);
+		}
+		auto threadCount = std::size_t{ 1 };
+		if (auto threads = extractOption(arguments, "-threads"))
+		{
+			threadCount = std::stoul(*threads);
+		}
+		auto memoryBudget = physicalMemorySize() / 2;
+		if (auto budget = extractOption(arguments, "-memoryBudget"))
+		{
+			memoryBudget = static_cast<std::size_t>(std::stoull(*budget)) * 1024 * 1024;
+		}
+		if (memoryBudget == 0)
+		{
+			memoryBudget = std::numeric_limits<std::size_t>::max();
+		}
 
 		constexpr auto maxBufferSize = 32 * 1024 * 1024;
-		for (const auto& argument : arguments)
+		auto scheduler = MemoryBudgetScheduler{ jobCount, memoryBudget };
+		auto costs = std::vector<std::size_t>(arguments.size(), 0);
+		if (scheduler.size() > 1)
 		{
-			try
+			for (auto i = std::size_t{ 0 }; i < arguments.size(); ++i)
 			{
-				std::cerr << "Reading index file " << argument << "..." << std::endl;
-				auto indexFileName = std::filesystem::path{ argument };
-				auto patchData = readChunks(std::ifstream{ indexFileName, std::ifstream::binary });
-				auto indexFileDirectory = indexFileName.parent_path();
-				auto inputFileName = indexFileDirectory / patchData.oldFileName;
-				auto outputFileName = indexFileDirectory / patchData.newFileName;
-				std::cerr << "Index file read, trying to create new file "
-					<< "[" << outputFileName << "] from [" << inputFileName << "]..." << std::endl;
-
-				auto output = std::ofstream{ outputFileName, std::ofstream::binary };
-				output.exceptions(output.exceptions() | output.badbit | output.failbit);
-				auto expectedSum = std::accumulate(patchData.dataChunks.begin(), patchData.dataChunks.end(), std::size_t{ 0 }, 
-					[](std::size_t sum, const DataChunk& chunk) {
-					return sum += chunk.length;
-				});
-				writeNewFileContent(output, 
-					escape(readEntireFile<std::uint8_t>(inputFileName), patchData.escapeData), patchData, maxBufferSize,
-					[expectedSum, progress = 0](std::size_t delta) mutable {
-					progress += delta;
-					std::cerr << makeMetricPrefix(progress) << "B (" << makePercent(progress, expectedSum) << ")          \r";
-				});
-				std::cerr << "Successfully created file " << outputFileName << ".      " << std::endl;
-			}
-			catch (const std::exception& e)
-			{
-				std::cerr << "ERROR: " << e.what() << std::endl << "This index file will be skipped." << std::endl;
+				try
+				{
+					costs.at(i) = estimateApplyMemory(arguments.at(i), mapped, threadCount, maxBufferSize);
+				}
+				catch (const std::exception&)
+				{
+					// Reported when the index file is applied
+				}
 			}
+			std::cerr << "Applying up to " << scheduler.size() << " index files at the same time, memory budget = "
+				<< makeMetricPrefix(memoryBudget) << "B" << std::endl;
+		}
+
+		auto logMutex = std::mutex{};
+		auto log = [&logMutex](const std::string& message) {
+			auto lock = std::lock_guard{ logMutex };
+			std::cerr << message << std::endl;
+		};
+		const auto options = ApplyOptions{ mapped, threadCount, maxBufferSize, inPlace, memoryBudget };
+		scheduler.run(costs, [&](std::size_t index) {
+			applyIndexFile(arguments.at(index), options, scheduler.size() == 1, log);
+		});
+		if (statsJsonFileName.has_value())
+		{
+			Instrumentation::instance().writeJson(*statsJsonFileName, "ARPatchApplier");
+			std::cerr << "Statistics written to " << *statsJsonFileName << std::endl;
 		}
 	}
 	catch (const std::exception& e)
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+// A long run of the new file which is an exact copy of the old file
+struct Anchor
+{
+	std::size_t newPosition;
+	std::size_t oldPosition;
+	std::size_t length;
+};
+
+// rsync style anchor search: the old file is indexed by the rolling hashes of its aligned blocks,
+// a rolling hash of the new file is looked up at every position, and every hit is verified and extended
+// in both directions. Any common substring of at least 2 * blockSize - 1 bytes contains an aligned block,
+// so all of them are found in linear time (plus the verification of hash collisions).
+class AnchorMatcher
+{
+public:
+	AnchorMatcher(const std::uint8_t* oldFile, std::size_t oldSize, std::size_t blockSize) :
+		oldFile{ oldFile },
+		oldSize{ oldSize },
+		blockSize{ std::max<std::size_t>(blockSize, 1) }
+	{
+		highestPower = 1;
+		for (auto i = std::size_t{ 1 }; i < this->blockSize; ++i)
+		{
+			highestPower *= multiplier;
+		}
+
+		auto blockCount = oldSize / this->blockSize;
+		// At least 2 slots, so the shift of the slot index stays below 64 even without any block
+		auto tableSize = std::size_t{ 2 };
+		for (shift = 63; tableSize < blockCount * 2 + 1; tableSize *= 2)
+		{
+			--shift;
+		}
+		table.assign(tableSize, Slot{ 0, empty });
+		for (auto block = std::size_t{ 0 }; block < blockCount; ++block)
+		{
+			auto position = block * this->blockSize;
+			auto hash = hashOf(oldFile + position);
+			for (auto slot = hash >> shift & (table.size() - 1);; slot = (slot + 1) & (table.size() - 1))
+			{
+				if (table[slot].position == empty)
+				{
+					table[slot] = Slot{ hash, position };
+					break;
+				}
+				if (table[slot].hash == hash && std::equal(oldFile + table[slot].position, oldFile + table[slot].position + this->blockSize, oldFile + position))
+				{
+					// Keep the first occurrence
+					break;
+				}
+			}
+		}
+	}
+
+	// Non overlapping anchors of at least minimumLength bytes, sorted by their position in the new file
+	std::vector<Anchor> findAnchors(const std::uint8_t* newFile, std::size_t newSize, std::size_t minimumLength) const
+	{
+		auto anchors = std::vector<Anchor>{};
+		// Shorter old files don't have any block to find
+		if (newSize < blockSize || oldSize < blockSize)
+		{
+			return anchors;
+		}
+
+		auto previousEnd = std::size_t{ 0 };
+		auto position = std::size_t{ 0 };
+		auto hash = hashOf(newFile);
+		while (true)
+		{
+			if (auto oldPosition = find(hash, newFile + position); oldPosition != empty)
+			{
+				auto anchor = extend(newFile, newSize, position, oldPosition, previousEnd);
+				if (anchor.length >= minimumLength)
+				{
+					anchors.push_back(anchor);
+					previousEnd = anchor.newPosition + anchor.length;
+					position = previousEnd;
+					if (position + blockSize > newSize)
+					{
+						break;
+					}
+					hash = hashOf(newFile + position);
+					continue;
+				}
+			}
+
+			if (position + blockSize >= newSize)
+			{
+				break;
+			}
+			hash = (hash - newFile[position] * highestPower) * multiplier + newFile[position + blockSize];
+			++position;
+		}
+		return anchors;
+	}
+
+private:
+	static constexpr std::uint64_t multiplier = 0x100000001B3ULL;
+	static constexpr std::size_t empty = static_cast<std::size_t>(-1);
+
+	struct Slot
+	{
+		std::uint64_t hash;
+		std::size_t position;
+	};
+
+	std::uint64_t hashOf(const std::uint8_t* data) const
+	{
+		auto hash = std::uint64_t{ 0 };
+		for (auto i = std::size_t{ 0 }; i < blockSize; ++i)
+		{
+			hash = hash * multiplier + data[i];
+		}
+		return hash;
+	}
+
+	std::size_t find(std::uint64_t hash, const std::uint8_t* data) const
+	{
+		// The low bits of a multiplicative hash are weak, so the slot is taken from the high bits
+		for (auto slot = hash >> shift & (table.size() - 1); table[slot].position != empty; slot = (slot + 1) & (table.size() - 1))
+		{
+			if (table[slot].hash == hash && std::equal(data, data + blockSize, oldFile + table[slot].position))
+			{
+				return table[slot].position;
+			}
+		}
+		return empty;
+	}
+
+	Anchor extend(const std::uint8_t* newFile, std::size_t newSize, std::size_t newPosition, std::size_t oldPosition, std::size_t lowerBound) const
+	{
+		auto length = blockSize;
+		while (newPosition + length < newSize && oldPosition + length < oldSize && newFile[newPosition + length] == oldFile[oldPosition + length])
+		{
+			++length;
+		}
+		while (newPosition > lowerBound && oldPosition > 0 && newFile[newPosition - 1] == oldFile[oldPosition - 1])
+		{
+			--newPosition;
+			--oldPosition;
+			++length;
+		}
+		return Anchor{ newPosition, oldPosition, length };
+	}
+
+	const std::uint8_t* oldFile;
+	std::size_t oldSize;
+	std::size_t blockSize;
+	std::uint64_t highestPower;
+	int shift = 63;
+	std::vector<Slot> table;
+};
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Directory of the BIG archives of Red Alert 3 ("BIGF" or "BIG4"): a header, then for every entry its offset and size
+// (32 bit big endian) and its null terminated name. The directory is followed by the data of the entries.
+struct BigArchiveEntry
+{
+	std::string name;
+	std::size_t offset;
+	std::size_t size;
+};
+
+inline std::optional<std::vector<BigArchiveEntry>> parseBigArchive(const std::uint8_t* data, std::size_t size)
+{
+	constexpr auto headerSize = std::size_t{ 16 };
+	constexpr auto bigF = std::array<std::uint8_t, 4>{ 'B', 'I', 'G', 'F' };
+	constexpr auto big4 = std::array<std::uint8_t, 4>{ 'B', 'I', 'G', '4' };
+	if (size < headerSize || (std::equal(bigF.begin(), bigF.end(), data) == false && std::equal(big4.begin(), big4.end(), data) == false))
+	{
+		return std::nullopt;
+	}
+	auto readBigEndian = [data](std::size_t position) {
+		return std::size_t{ data[position] } << 24 | std::size_t{ data[position + 1] } << 16 | std::size_t{ data[position + 2] } << 8 | data[position + 3];
+	};
+
+	const auto entryCount = readBigEndian(8);
+	auto entries = std::vector<BigArchiveEntry>{};
+	auto position = headerSize;
+	for (auto i = std::size_t{ 0 }; i < entryCount; ++i)
+	{
+		if (size - position < 9)
+		{
+			return std::nullopt;
+		}
+		auto entry = BigArchiveEntry{ {}, readBigEndian(position), readBigEndian(position + 4) };
+		position += 8;
+		const auto nameEnd = std::find(data + position, data + size, std::uint8_t{ 0 });
+		if (nameEnd == data + size || entry.offset > size || entry.size > size - entry.offset)
+		{
+			return std::nullopt;
+		}
+		entry.name.assign(data + position, nameEnd);
+		position = static_cast<std::size_t>(nameEnd - data) + 1;
+		entries.push_back(std::move(entry));
+	}
+	return entries;
+}
+
+// Part of a BIG archive: the header and the directory (with an empty name), or an entry followed by the padding up to the next one
+struct BigArchiveRegion
+{
+	std::string name;
+	std::size_t begin;
+	std::size_t end;
+};
+
+// Regions in file order, or nullopt if entries overlap (entries sharing the same data are a single region, named after the first one)
+inline std::optional<std::vector<BigArchiveRegion>> splitBigArchive(std::vector<BigArchiveEntry> entries, std::size_t size)
+{
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [](const BigArchiveEntry& entry) { return entry.size == 0; }), entries.end());
+	std::stable_sort(entries.begin(), entries.end(), [](const BigArchiveEntry& left, const BigArchiveEntry& right) {
+		return left.offset != right.offset ? left.offset < right.offset : left.size > right.size;
+	});
+	auto regions = std::vector<BigArchiveRegion>{ BigArchiveRegion{ {}, 0, entries.empty() ? size : entries.front().offset } };
+	auto previousEnd = regions.front().end;
+	for (const auto& entry : entries)
+	{
+		if (regions.size() > 1 && entry.offset == regions.back().begin)
+		{
+			continue;
+		}
+		if (entry.offset < previousEnd)
+		{
+			return std::nullopt;
+		}
+		regions.back().end = entry.offset;
+		regions.push_back(BigArchiveRegion{ entry.name, entry.offset, size });
+		previousEnd = entry.offset + entry.size;
+	}
+	return regions;
+}
+
+// A region of the new archive, and the region of the old archive with the same name, if any
+struct BigArchiveRegionPair
+{
+	BigArchiveRegion newRegion;
+	std::optional<BigArchiveRegion> oldRegion;
+};
+
+inline std::vector<BigArchiveRegionPair> pairBigArchiveRegions(const std::vector<BigArchiveRegion>& oldRegions, const std::vector<BigArchiveRegion>& newRegions)
+{
+	auto oldRegionsByName = std::map<std::string, const BigArchiveRegion*>{};
+	for (const auto& region : oldRegions)
+	{
+		oldRegionsByName.emplace(region.name, &region);
+	}
+	auto result = std::vector<BigArchiveRegionPair>{};
+	for (const auto& region : newRegions)
+	{
+		auto oldRegion = oldRegionsByName.find(region.name);
+		result.push_back(BigArchiveRegionPair{ region, oldRegion != oldRegionsByName.end() ? std::optional{ *oldRegion->second } : std::nullopt });
+	}
+	return result;
+}
\ No newline at end of file
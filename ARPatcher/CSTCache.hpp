@@ -0,0 +1,224 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <sdsl/suffix_trees.hpp>
+#include <Escape.hpp>
+#include "Utilities.hpp"
+#include "Hash.hpp"
+#include "IndexBackends.hpp"
+
+// Persistent cache of the suffix trees built for an old file.
+// Every entry is a directory named after the cache key, containing the escaped int_vector and the CST of every section.
+// The manifest is written last, so entries without a manifest are incomplete and will be ignored.
+struct CSTCacheKey
+{
+	std::uint64_t contentHash;
+	std::uint8_t escape;
+	std::size_t estimatedNewSize;
+	std::size_t maxSingleBufferSize;
+	IndexBackend backend = IndexBackend::cst;
+
+	std::string toString() const
+	{
+		auto parameters = XXHash64{ contentHash };
+		parameters.update(&escape, sizeof(escape));
+		parameters.update(&estimatedNewSize, sizeof(estimatedNewSize));
+		parameters.update(&maxSingleBufferSize, sizeof(maxSingleBufferSize));
+		// The default backend keeps the names of the entries of previous versions
+		auto backendSuffix = backend == IndexBackend::cst ? std::string{} : "-" + ::toString(backend);
+		return toHexString(contentHash) + "-" + toHexString(parameters.digest()) + backendSuffix;
+	}
+};
+
+class CSTCache
+{
+public:
+	static constexpr auto manifestFileName = "manifest.txt";
+
+	explicit CSTCache(std::filesystem::path directory) : directory{ std::move(directory) } {}
+
+	template<typename Container>
+	static CSTCacheKey makeKey(const Container& oldFile, const EscapeData& escapeData, std::size_t maxSingleBufferSize)
+	{
+		return makeKey(hash64(oldFile), escapeData, maxSingleBufferSize);
+	}
+
+	// When the hash of the old file is already known
+	static CSTCacheKey makeKey(std::uint64_t oldFileHash, const EscapeData& escapeData, std::size_t maxSingleBufferSize,
+		IndexBackend backend = IndexBackend::cst)
+	{
+		return CSTCacheKey{ oldFileHash, escapeData.escape, escapeData.estimatedNewSize, maxSingleBufferSize, backend };
+	}
+
+	std::filesystem::path entryDirectory(const CSTCacheKey& key) const
+	{
+		return directory / key.toString();
+	}
+
+	// Returns false if there isn't any complete entry for this key
+	template<typename CSTs>
+	bool load(const CSTCacheKey& key, CSTs& trees) const
+	{
+		const auto entry = entryDirectory(key);
+		auto manifest = std::ifstream{ entry / manifestFileName };
+		auto sectionsCount = std::size_t{};
+		auto escape = unsigned{};
+		if (!(manifest >> sectionsCount >> escape) || escape != key.escape)
+		{
+			return false;
+		}
+
+		trees.sections.clear();
+		trees.sections.resize(sectionsCount);
+		for (auto i = std::size_t{ 0 }; i < sectionsCount; ++i)
+		{
+			auto& section = trees.sections.at(i);
+			auto dataSize = std::size_t{};
+			if (!(manifest >> section.offset >> dataSize))
+			{
+				return false;
+			}
+			section.index = i;
+			std::cerr << "Loading cached CST for old file section #" << (i + 1) << " (" << makeMetricPrefix(dataSize) << "B)...\r";
+			if (sdsl::load_from_file(section.data, sectionFileName(entry, i, ".data")) == false
+				|| sdsl::load_from_file(section.cst, sectionFileName(entry, i, ".cst")) == false
+				|| section.data.size() != dataSize)
+			{
+				trees.sections.clear();
+				return false;
+			}
+			std::cerr << "Loaded cached CST for old file section #" << (i + 1) << " (" << makeMetricPrefix(dataSize) << "B).   " << std::endl;
+		}
+
+		// Keep track of usage for prune()
+		std::filesystem::last_write_time(entry / manifestFileName, std::filesystem::file_time_type::clock::now());
+		return true;
+	}
+
+	template<typename CSTs>
+	void store(const CSTCacheKey& key, const CSTs& trees) const
+	{
+		const auto entry = entryDirectory(key);
+		auto temporary = entry;
+		temporary += ".tmp" + std::to_string(std::random_device{}());
+		std::filesystem::create_directories(temporary);
+		try
+		{
+			for (const auto& section : trees.sections)
+			{
+				if (sdsl::store_to_file(section.data, sectionFileName(temporary, section.index, ".data")) == false
+					|| sdsl::store_to_file(section.cst, sectionFileName(temporary, section.index, ".cst")) == false)
+				{
+					throw std::runtime_error{ "Failed to store CST into cache directory " + temporary.string() };
+				}
+			}
+
+			{
+				auto manifest = std::ofstream{ temporary / manifestFileName };
+				manifest.exceptions(manifest.exceptions() | manifest.badbit | manifest.failbit);
+				manifest << trees.sections.size() << ' ' << static_cast<unsigned>(key.escape) << '\n';
+				for (const auto& section : trees.sections)
+				{
+					manifest << section.offset << ' ' << section.data.size() << '\n';
+				}
+			}
+
+			// Another job storing the same old file may have been faster, its entry is as good as ours
+			if (std::filesystem::exists(entry / manifestFileName) == false)
+			{
+				std::filesystem::remove_all(entry);
+				auto error = std::error_code{};
+				std::filesystem::rename(temporary, entry, error);
+				if (error && std::filesystem::exists(entry / manifestFileName) == false)
+				{
+					throw std::filesystem::filesystem_error{ "Failed to move CST into cache", temporary, entry, error };
+				}
+			}
+			auto error = std::error_code{};
+			std::filesystem::remove_all(temporary, error);
+		}
+		catch (...)
+		{
+			auto error = std::error_code{};
+			std::filesystem::remove_all(temporary, error);
+			throw;
+		}
+		std::cerr << "CST stored in cache " << entry << std::endl;
+	}
+
+	void invalidate(const CSTCacheKey& key) const
+	{
+		std::filesystem::remove_all(entryDirectory(key));
+	}
+
+	// Removes least recently used entries (and leftovers of interrupted stores) until the cache is not larger than maxSize
+	void prune(std::uintmax_t maxSize) const
+	{
+		struct Entry
+		{
+			std::filesystem::path path;
+			std::filesystem::file_time_type lastUsed;
+			std::uintmax_t size;
+		};
+
+		if (std::filesystem::exists(directory) == false)
+		{
+			return;
+		}
+
+		auto entries = std::vector<Entry>{};
+		auto totalSize = std::uintmax_t{ 0 };
+		for (const auto& item : std::filesystem::directory_iterator{ directory })
+		{
+			if (item.is_directory() == false)
+			{
+				continue;
+			}
+			const auto manifest = item.path() / manifestFileName;
+			if (std::filesystem::exists(manifest) == false)
+			{
+				std::cerr << "Removing incomplete cache entry " << item.path() << std::endl;
+				std::filesystem::remove_all(item.path());
+				continue;
+			}
+
+			auto size = std::uintmax_t{ 0 };
+			for (const auto& file : std::filesystem::directory_iterator{ item.path() })
+			{
+				size += file.file_size();
+			}
+			totalSize += size;
+			entries.push_back(Entry{ item.path(), std::filesystem::last_write_time(manifest), size });
+		}
+
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+			return a.lastUsed < b.lastUsed;
+		});
+		for (const auto& entry : entries)
+		{
+			if (totalSize <= maxSize)
+			{
+				break;
+			}
+			std::cerr << "Removing cache entry " << entry.path << " (" << makeMetricPrefix(entry.size) << "B)" << std::endl;
+			std::filesystem::remove_all(entry.path);
+			totalSize -= entry.size;
+		}
+		std::cerr << "CST cache size: " << makeMetricPrefix(totalSize) << 'B' << std::endl;
+	}
+
+private:
+	static std::string sectionFileName(const std::filesystem::path& entry, std::size_t index, const char* extension)
+	{
+		return (entry / ("section" + std::to_string(index) + extension)).string();
+	}
+
+	std::filesystem::path directory;
+};
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "Hash.hpp"
+
+struct FileChecksum
+{
+	std::uint64_t size = 0;
+	std::uint64_t hash = 0;
+};
+
+// Hashes of the old and new file contents stored in an index file, so a wrong old file is rejected
+// before anything is written, and the new file can be validated block by block while it's written.
+struct ContentChecksums
+{
+	static constexpr std::uint32_t defaultBlockSize = 1024 * 1024;
+
+	std::uint64_t oldFileSize = 0;
+	std::uint64_t oldFileHash = 0;
+	std::uint64_t newFileSize = 0;
+	std::uint64_t newFileHash = 0;
+	std::uint32_t blockSize = defaultBlockSize;
+	// Hash of every blockSize bytes of the new file (the last block may be shorter)
+	std::vector<std::uint64_t> blockHashes;
+	// Additional old files of multi-reference index files, see WidePatchData::referenceFileNames
+	std::vector<FileChecksum> referenceFiles;
+};
+
+inline ContentChecksums makeContentChecksums(std::uint64_t oldFileSize,
+	std::uint64_t oldFileHash,
+	const std::vector<std::uint8_t>& newFile,
+	std::uint32_t blockSize = ContentChecksums::defaultBlockSize)
+{
+	auto result = ContentChecksums{ oldFileSize, oldFileHash, newFile.size(), hash64(newFile), blockSize, {} };
+	for (auto begin = std::size_t{ 0 }; begin < newFile.size(); begin += blockSize)
+	{
+		auto block = XXHash64{};
+		block.update(newFile.data() + begin, std::min<std::size_t>(blockSize, newFile.size() - begin));
+		result.blockHashes.push_back(block.digest());
+	}
+	return result;
+}
+
+// hashFile() returns the XXHash64 of the file; it's only called when the size is right
+template<typename HashFile>
+void checkFileContent(const FileChecksum& expected, std::uint64_t fileSize, HashFile hashFile, const std::string& description)
+{
+	if (fileSize != expected.size)
+	{
+		throw std::runtime_error{ description + " size is " + std::to_string(fileSize) + " bytes instead of "
+			+ std::to_string(expected.size) + ", it isn't the file this index file was generated from" };
+	}
+	if (hashFile() != expected.hash)
+	{
+		throw std::runtime_error{ description + " checksum mismatch, it isn't the file this index file was generated from (modified?)" };
+	}
+}
+
+inline void checkFileContent(const FileChecksum& expected, const std::uint8_t* file, std::size_t fileSize, const std::string& description)
+{
+	checkFileContent(expected, fileSize, [file, fileSize]() {
+		auto hash = XXHash64{};
+		hash.update(file, fileSize);
+		return hash.digest();
+	}, description);
+}
+
+// Throws if the old file isn't the one the index file was generated from
+template<typename HashFile>
+void checkOldFile(const ContentChecksums& checksums, std::uint64_t oldFileSize, HashFile hashOldFile)
+{
+	checkFileContent(FileChecksum{ checksums.oldFileSize, checksums.oldFileHash }, oldFileSize, hashOldFile, "Old file");
+}
+
+inline void checkOldFile(const ContentChecksums& checksums, const std::uint8_t* oldFile, std::size_t oldFileSize)
+{
+	checkFileContent(FileChecksum{ checksums.oldFileSize, checksums.oldFileHash }, oldFile, oldFileSize, "Old file");
+}
+
+// Checksum of one of the additional old files of multi-reference index files
+inline const FileChecksum& referenceFileChecksum(const ContentChecksums& checksums, std::size_t reference)
+{
+	if (reference >= checksums.referenceFiles.size())
+	{
+		throw std::runtime_error{ "Index file doesn't contain the checksum of reference file #" + std::to_string(reference + 1) };
+	}
+	return checksums.referenceFiles[reference];
+}
+
+// Same as checkOldFile, for the additional old files of multi-reference index files
+template<typename HashFile>
+void checkReferenceFile(const ContentChecksums& checksums, std::size_t reference, std::uint64_t fileSize, HashFile hashFile)
+{
+	checkFileContent(referenceFileChecksum(checksums, reference), fileSize, hashFile, "Reference file #" + std::to_string(reference + 1));
+}
+
+inline void checkReferenceFile(const ContentChecksums& checksums, std::size_t reference, const std::uint8_t* file, std::size_t fileSize)
+{
+	checkFileContent(referenceFileChecksum(checksums, reference), file, fileSize, "Reference file #" + std::to_string(reference + 1));
+}
+
+// Validates a contiguous range of the new file, starting at any offset, against the block hashes as it's written.
+// Blocks which are only partially inside the range can't be checked and are reported by uncheckedBlocks().
+class NewFileValidator
+{
+public:
+	NewFileValidator(const ContentChecksums& checksums, std::uint64_t offset) :
+		checksums{ &checksums },
+		offset{ offset }
+	{
+		if (offset % checksums.blockSize != 0)
+		{
+			unchecked.push_back(offset / checksums.blockSize);
+		}
+	}
+
+	void update(const std::uint8_t* data, std::size_t size)
+	{
+		if (offset + size > checksums->newFileSize)
+		{
+			throw std::runtime_error{ "New file is larger than expected, corrupted index file?" };
+		}
+		while (size > 0)
+		{
+			auto block = offset / checksums->blockSize;
+			auto blockEnd = std::min<std::uint64_t>((block + 1) * checksums->blockSize, checksums->newFileSize);
+			auto count = static_cast<std::size_t>(std::min<std::uint64_t>(size, blockEnd - offset));
+			if (isUnchecked(block) == false)
+			{
+				current.update(data, count);
+			}
+			data += count;
+			size -= count;
+			offset += count;
+			if (offset == blockEnd)
+			{
+				if (isUnchecked(block) == false && current.digest() != checksums->blockHashes.at(block))
+				{
+					throw std::runtime_error{ "New file checksum mismatch in block #" + std::to_string(block) + ", corrupted index file / old file?" };
+				}
+				current = XXHash64{};
+			}
+		}
+	}
+
+	// Call when the range is complete; a block cut by the end of the range is added to the unchecked blocks
+	void finish()
+	{
+		if (offset % checksums->blockSize != 0 && offset != checksums->newFileSize && isUnchecked(offset / checksums->blockSize) == false)
+		{
+			unchecked.push_back(offset / checksums->blockSize);
+		}
+	}
+
+	// Offset in the new file of the next byte
+	std::uint64_t position() const
+	{
+		return offset;
+	}
+
+	const std::vector<std::uint64_t>& uncheckedBlocks() const
+	{
+		return unchecked;
+	}
+
+private:
+	bool isUnchecked(std::uint64_t block) const
+	{
+		return std::find(unchecked.begin(), unchecked.end(), block) != unchecked.end();
+	}
+
+	const ContentChecksums* checksums;
+	std::uint64_t offset;
+	XXHash64 current;
+	std::vector<std::uint64_t> unchecked;
+};
+
+// Unbuffered stream buffer passing everything to another stream buffer through a NewFileValidator
+class ValidatingStreamBuffer : public std::streambuf
+{
+public:
+	ValidatingStreamBuffer(std::streambuf& target, NewFileValidator& validator) : target{ &target }, validator{ &validator } {}
+
+protected:
+	std::streamsize xsputn(const char* data, std::streamsize size) override
+	{
+		validator->update(reinterpret_cast<const std::uint8_t*>(data), static_cast<std::size_t>(size));
+		return target->sputn(data, size);
+	}
+
+	int_type overflow(int_type character) override
+	{
+		if (traits_type::eq_int_type(character, traits_type::eof()) == false)
+		{
+			auto value = traits_type::to_char_type(character);
+			xsputn(&value, 1);
+		}
+		return traits_type::not_eof(character);
+	}
+
+	int sync() override
+	{
+		return target->pubsync();
+	}
+
+private:
+	std::streambuf* target;
+	NewFileValidator* validator;
+};
\ No newline at end of file
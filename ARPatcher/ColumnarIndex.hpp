@@ -0,0 +1,309 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "WidePatchData.hpp"
+#include "Utilities.hpp"
+#include "EntropyCoding.hpp"
+
+// A chunk of a columnar index file, pointing into the mapped file instead of owning its literal data
+struct ChunkView
+{
+	std::uint64_t length;
+	std::uint64_t sourcePosition;
+	// Literal data (length bytes) if sourcePosition is uint64_t(-1)
+	const std::uint8_t* data;
+};
+
+inline const std::uint8_t* literalData(const WideDataChunk& chunk)
+{
+	return chunk.data.data();
+}
+
+inline const std::uint8_t* literalData(const ChunkView& chunk)
+{
+	return chunk.data;
+}
+
+// Chunk list encoding of columnar index files, meant to be used directly from a memory mapped file.
+// Chunks are grouped in blocks of blockChunks chunks. Every block stores the bit width of its lengths and of its copy codes,
+// followed by the bit-packed lengths and the bit-packed codes: 0 for literal chunks, or for copy chunks
+// zigzag(sourcePosition - end of the previous copy) + 1. All the literal data is in a single blob at the end.
+// Layout: u64 chunk count, u64 total chunk length, u64 literal data size, u64 packed columns size,
+// then for every block {u64 offset in the packed columns, u64 offset of its first literal, u64 end of the previous copy},
+// the packed columns (followed by 8 bytes of padding) and the literal data.
+class ColumnarIndex
+{
+public:
+	static constexpr std::size_t blockChunks = 128;
+
+	// data points to the chunk list encoding, which must stay valid (mapped) as long as this object is used
+	ColumnarIndex(const std::uint8_t* data, std::size_t size)
+	{
+		if (size < headerSize)
+		{
+			throw std::runtime_error{ "Truncated columnar index file" };
+		}
+		chunkCount = loadLittleEndian<std::uint64_t>(data);
+		totalLength = loadLittleEndian<std::uint64_t>(data + 8);
+		literalSize = loadLittleEndian<std::uint64_t>(data + 16);
+		packedSize = loadLittleEndian<std::uint64_t>(data + 24);
+		const auto blockCount = (chunkCount + blockChunks - 1) / blockChunks;
+		const auto available = static_cast<std::uint64_t>(size - headerSize);
+		if (blockCount > available / directoryEntrySize
+			|| packedSize < padding + 2 * blockCount
+			|| packedSize > available - blockCount * directoryEntrySize
+			|| literalSize != available - blockCount * directoryEntrySize - packedSize)
+		{
+			throw std::runtime_error{ "Corrupted columnar index file" };
+		}
+		directory = data + headerSize;
+		packed = directory + blockCount * directoryEntrySize;
+		literals = packed + packedSize;
+	}
+
+	std::size_t size() const
+	{
+		return static_cast<std::size_t>(chunkCount);
+	}
+
+	// Sum of the chunk lengths, that is the size of the escaped new file
+	std::uint64_t escapedSize() const
+	{
+		return totalLength;
+	}
+
+	// Iterates the chunks from any chunk onwards, decoding them a block at a time
+	class Cursor
+	{
+	public:
+		Cursor(const ColumnarIndex& index, std::size_t first) : index{ &index }, position{ first }
+		{
+			if (position < index.size())
+			{
+				loadBlock(position / blockChunks);
+			}
+		}
+
+		// The next chunk, or nullptr after the last one; the chunk stays valid until the next call
+		const ChunkView* next()
+		{
+			if (position >= index->size())
+			{
+				return nullptr;
+			}
+			if (position % blockChunks == 0 && position / blockChunks != loadedBlock)
+			{
+				loadBlock(position / blockChunks);
+			}
+			return &views[position++ % blockChunks];
+		}
+
+	private:
+		void loadBlock(std::size_t block)
+		{
+			const auto* entry = index->directory + block * directoryEntrySize;
+			const auto packedOffset = loadLittleEndian<std::uint64_t>(entry);
+			auto literalOffset = loadLittleEndian<std::uint64_t>(entry + 8);
+			auto previousCopyEnd = loadLittleEndian<std::int64_t>(entry + 16);
+			const auto count = std::min<std::size_t>(blockChunks, index->size() - block * blockChunks);
+			if (packedOffset > index->packedSize - padding - 2 || literalOffset > index->literalSize)
+			{
+				throw std::runtime_error{ "Corrupted columnar index file" };
+			}
+			const auto* columns = index->packed + packedOffset;
+			const auto lengthBits = columns[0];
+			const auto codeBits = columns[1];
+			const auto lengthBytes = (count * lengthBits + 7) / 8;
+			const auto codeBytes = (count * codeBits + 7) / 8;
+			if (lengthBits > maxBits || codeBits > maxBits || lengthBytes + codeBytes > index->packedSize - padding - 2 - packedOffset)
+			{
+				throw std::runtime_error{ "Corrupted columnar index file" };
+			}
+			unpackBits(columns + 2, lengthBits, count, lengths.data());
+			unpackBits(columns + 2 + lengthBytes, codeBits, count, codes.data());
+
+			for (auto i = std::size_t{ 0 }; i < count; ++i)
+			{
+				auto& view = views[i];
+				view.length = lengths[i];
+				if (codes[i] == 0)
+				{
+					if (view.length > index->literalSize - literalOffset)
+					{
+						throw std::runtime_error{ "Literal data of index file is too short" };
+					}
+					view.sourcePosition = static_cast<std::uint64_t>(-1);
+					view.data = index->literals + literalOffset;
+					literalOffset += view.length;
+				}
+				else
+				{
+					auto sourcePosition = previousCopyEnd + zigzagDecode(codes[i] - 1);
+					if (sourcePosition < 0 || sourcePosition >= maxSourcePosition)
+					{
+						throw std::runtime_error{ "Invalid chunk source position in index file" };
+					}
+					view.sourcePosition = static_cast<std::uint64_t>(sourcePosition);
+					view.data = nullptr;
+					previousCopyEnd = sourcePosition + static_cast<std::int64_t>(view.length);
+				}
+			}
+			loadedBlock = block;
+		}
+
+		const ColumnarIndex* index;
+		std::size_t position;
+		std::size_t loadedBlock = std::numeric_limits<std::size_t>::max();
+		std::array<std::uint64_t, blockChunks> lengths;
+		std::array<std::uint64_t, blockChunks> codes;
+		std::array<ChunkView, blockChunks> views;
+	};
+
+	Cursor cursor(std::size_t first) const
+	{
+		return Cursor{ *this, first };
+	}
+
+	static void write(std::ostream& out, const std::vector<WideDataChunk>& chunks)
+	{
+		auto totalLength = std::uint64_t{ 0 };
+		auto literalSize = std::uint64_t{ 0 };
+		auto directory = std::vector<std::uint8_t>{};
+		auto packed = std::vector<std::uint8_t>{};
+		auto lengths = std::array<std::uint64_t, blockChunks>{};
+		auto codes = std::array<std::uint64_t, blockChunks>{};
+		auto previousCopyEnd = std::int64_t{ 0 };
+		for (auto begin = std::size_t{ 0 }; begin < chunks.size(); begin += blockChunks)
+		{
+			for (auto value : { static_cast<std::uint64_t>(packed.size()), literalSize, static_cast<std::uint64_t>(previousCopyEnd) })
+			{
+				appendLittleEndian(directory, value);
+			}
+			const auto count = std::min(blockChunks, chunks.size() - begin);
+			auto lengthBits = std::uint8_t{ 0 };
+			auto codeBits = std::uint8_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < count; ++i)
+			{
+				const auto& chunk = chunks[begin + i];
+				if (chunk.length >= static_cast<std::uint64_t>(maxSourcePosition)
+					|| (isLiteralChunk(chunk) == false && chunk.sourcePosition >= static_cast<std::uint64_t>(maxSourcePosition)))
+				{
+					throw std::length_error{ "Chunk is too large for a columnar index file" };
+				}
+				lengths[i] = chunk.length;
+				totalLength += chunk.length;
+				if (isLiteralChunk(chunk))
+				{
+					codes[i] = 0;
+					literalSize += chunk.length;
+				}
+				else
+				{
+					codes[i] = zigzagEncode(static_cast<std::int64_t>(chunk.sourcePosition) - previousCopyEnd) + 1;
+					previousCopyEnd = static_cast<std::int64_t>(chunk.sourcePosition) + chunk.length;
+				}
+				lengthBits = std::max(lengthBits, bitWidth(lengths[i]));
+				codeBits = std::max(codeBits, bitWidth(codes[i]));
+			}
+			packed.push_back(lengthBits);
+			packed.push_back(codeBits);
+			packBits(packed, lengths.data(), count, lengthBits);
+			packBits(packed, codes.data(), count, codeBits);
+		}
+		packed.resize(packed.size() + padding, 0);
+
+		auto header = std::vector<std::uint8_t>{};
+		for (auto value : { static_cast<std::uint64_t>(chunks.size()), totalLength, literalSize, static_cast<std::uint64_t>(packed.size()) })
+		{
+			appendLittleEndian(header, value);
+		}
+		for (const auto* part : { &header, &directory, &packed })
+		{
+			out.write(reinterpret_cast<const char*>(part->data()), part->size());
+		}
+		for (const auto& chunk : chunks)
+		{
+			if (isLiteralChunk(chunk))
+			{
+				out.write(reinterpret_cast<const char*>(chunk.data.data()), chunk.length);
+			}
+		}
+	}
+
+private:
+	static constexpr std::size_t headerSize = 4 * sizeof(std::uint64_t);
+	static constexpr std::size_t directoryEntrySize = 3 * sizeof(std::uint64_t);
+	// Unpacking always loads 8 bytes at once
+	static constexpr std::size_t padding = sizeof(std::uint64_t);
+	// Largest bit width which can be packed and unpacked 8 bytes at a time; lengths and source positions stay far below it
+	static constexpr std::uint8_t maxBits = 56;
+	static constexpr std::int64_t maxSourcePosition = std::int64_t{ 1 } << 52;
+
+	static std::uint8_t bitWidth(std::uint64_t value)
+	{
+		auto bits = std::uint8_t{ 0 };
+		for (; value != 0; value >>= 1)
+		{
+			++bits;
+		}
+		return bits;
+	}
+
+	static void appendLittleEndian(std::vector<std::uint8_t>& out, std::uint64_t value)
+	{
+		for (auto i = 0; i < 8; ++i)
+		{
+			out.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+		}
+	}
+
+	// Values must fit in bits, which is at most maxBits
+	static void packBits(std::vector<std::uint8_t>& out, const std::uint64_t* values, std::size_t count, std::uint8_t bits)
+	{
+		auto accumulator = std::uint64_t{ 0 };
+		auto filled = 0u;
+		for (auto i = std::size_t{ 0 }; i < count; ++i)
+		{
+			accumulator |= values[i] << filled;
+			filled += bits;
+			for (; filled >= 8; filled -= 8)
+			{
+				out.push_back(static_cast<std::uint8_t>(accumulator));
+				accumulator >>= 8;
+			}
+		}
+		if (filled > 0)
+		{
+			out.push_back(static_cast<std::uint8_t>(accumulator));
+		}
+	}
+
+	// Branch free loop with one unaligned 64 bit load per value, which compilers can vectorize (assumes a little endian machine)
+	static void unpackBits(const std::uint8_t* data, std::uint8_t bits, std::size_t count, std::uint64_t* values)
+	{
+		const auto mask = (std::uint64_t{ 1 } << bits) - 1;
+		for (auto i = std::size_t{ 0 }; i < count; ++i)
+		{
+			const auto bit = i * bits;
+			auto word = std::uint64_t{};
+			std::memcpy(&word, data + bit / 8, sizeof(word));
+			values[i] = (word >> (bit % 8)) & mask;
+		}
+	}
+
+	std::uint64_t chunkCount;
+	std::uint64_t totalLength;
+	std::uint64_t literalSize;
+	std::uint64_t packedSize;
+	const std::uint8_t* directory;
+	const std::uint8_t* packed;
+	const std::uint8_t* literals;
+};
\ No newline at end of file
@@ -0,0 +1,163 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <initializer_list>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include "WidePatchData.hpp"
+#include "EntropyCoding.hpp"
+
+// Chunk list encoding of compact index files.
+// Chunks are grouped in frames, so they can be encoded and decoded in a streaming fashion. A frame is:
+// varint chunk count (0 ends the list), varint size + entropy coded chunk headers, varint size + entropy coded literal data.
+// A chunk header is varint length, followed by varint 0 for literal chunks, or for copy chunks
+// (zigzag(sourcePosition - end of the previous copy) << 1) | 1, since copies usually continue where the previous one stopped.
+class CompactChunkWriter
+{
+public:
+	// A frame is flushed once either part reaches its limit
+	static constexpr std::size_t maxFrameHeadersSize = 256 * 1024;
+	static constexpr std::size_t maxFrameLiteralsSize = 1024 * 1024;
+
+	explicit CompactChunkWriter(std::ostream& out) : out{ &out } {}
+
+	void add(const WideDataChunk& chunk)
+	{
+		appendVarint(headers, chunk.length);
+		if (isLiteralChunk(chunk))
+		{
+			appendVarint(headers, 0);
+			literals.insert(literals.end(), chunk.data.begin(), chunk.data.begin() + chunk.length);
+		}
+		else
+		{
+			appendVarint(headers, zigzagEncode(static_cast<std::int64_t>(chunk.sourcePosition) - previousCopyEnd) << 1 | 1);
+			previousCopyEnd = static_cast<std::int64_t>(chunk.sourcePosition) + chunk.length;
+		}
+		++chunkCount;
+
+		if (headers.size() >= maxFrameHeadersSize || literals.size() >= maxFrameLiteralsSize)
+		{
+			flushFrame();
+		}
+	}
+
+	void finish()
+	{
+		flushFrame();
+		writeVarint(*out, 0);
+	}
+
+private:
+	void flushFrame()
+	{
+		if (chunkCount == 0)
+		{
+			return;
+		}
+		writeVarint(*out, chunkCount);
+		for (const auto* block : { &headers, &literals })
+		{
+			auto encoded = RansCoder::encode(block->data(), block->size());
+			writeVarint(*out, encoded.size());
+			out->write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+		}
+		headers.clear();
+		literals.clear();
+		chunkCount = 0;
+	}
+
+	std::ostream* out;
+	std::vector<std::uint8_t> headers;
+	std::vector<std::uint8_t> literals;
+	std::size_t chunkCount = 0;
+	std::int64_t previousCopyEnd = 0;
+};
+
+class CompactChunkReader
+{
+public:
+	explicit CompactChunkReader(std::istream& in) : in{ &in } {}
+
+	// The next chunk, or nullptr after the last one; the chunk stays valid until the next call
+	WideDataChunk* next()
+	{
+		if (remainingInFrame == 0 && loadFrame() == false)
+		{
+			return nullptr;
+		}
+		--remainingInFrame;
+
+		const auto length = readVarint(header, headers.data() + headers.size());
+		const auto tag = readVarint(header, headers.data() + headers.size());
+		if (length > maxOffset)
+		{
+			throw std::runtime_error{ "Invalid chunk length in index file" };
+		}
+		if (tag == 0)
+		{
+			if (static_cast<std::size_t>(literals.data() + literals.size() - literal) < length)
+			{
+				throw std::runtime_error{ "Literal data of index file is too short" };
+			}
+			current.emplace(length, static_cast<std::uint64_t>(-1), std::vector<std::uint8_t>(literal, literal + length));
+			literal += length;
+		}
+		else
+		{
+			auto sourcePosition = previousCopyEnd + zigzagDecode(tag >> 1);
+			if (sourcePosition < 0 || static_cast<std::uint64_t>(sourcePosition) > maxOffset)
+			{
+				throw std::runtime_error{ "Invalid chunk source position in index file" };
+			}
+			current.emplace(length, static_cast<std::uint64_t>(sourcePosition), std::vector<std::uint8_t>{});
+			previousCopyEnd = sourcePosition + static_cast<std::int64_t>(length);
+		}
+		return &*current;
+	}
+
+private:
+	// Larger lengths and source positions are rejected, which keeps the arithmetic far from overflows
+	static constexpr std::uint64_t maxOffset = std::uint64_t{ 1 } << 56;
+
+	bool loadFrame()
+	{
+		if (finished)
+		{
+			return false;
+		}
+		remainingInFrame = readVarint(*in);
+		if (remainingInFrame == 0)
+		{
+			finished = true;
+			return false;
+		}
+		for (auto* block : { &headers, &literals })
+		{
+			auto encoded = std::vector<std::uint8_t>(static_cast<std::size_t>(readVarint(*in)));
+			if (in->read(reinterpret_cast<char*>(encoded.data()), encoded.size()).gcount() != static_cast<std::streamsize>(encoded.size()))
+			{
+				throw std::runtime_error{ "Unexpected end of index file" };
+			}
+			const auto* data = encoded.data();
+			*block = RansCoder::decode(data, encoded.data() + encoded.size());
+		}
+		header = headers.data();
+		literal = literals.data();
+		return true;
+	}
+
+	std::istream* in;
+	std::vector<std::uint8_t> headers;
+	std::vector<std::uint8_t> literals;
+	const std::uint8_t* header = nullptr;
+	const std::uint8_t* literal = nullptr;
+	std::uint64_t remainingInFrame = 0;
+	std::int64_t previousCopyEnd = 0;
+	bool finished = false;
+	std::optional<WideDataChunk> current;
+};
\ No newline at end of file
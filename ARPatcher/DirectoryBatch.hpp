@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "IndexBackends.hpp"
+
+// Pairs the files of an old directory and of a new directory by relative path, for -generateDirectory.
+// Files of the new directory are either unchanged, patched (an index file is generated) or added (copied as they are, also when the old file is empty);
+// files which only exist in the old directory are removed.
+enum class DirectoryFileStatus
+{
+	unchanged,
+	patched,
+	added,
+	removed
+};
+
+// The index file of a patched file is named after its relative path, and builds the new file next to the old one,
+// with the same name followed by directoryNewFileExtension
+constexpr auto directoryIndexFileExtension = ".idx";
+constexpr auto directoryNewFileExtension = ".new";
+
+struct DirectoryFile
+{
+	std::filesystem::path relativePath;
+	DirectoryFileStatus status;
+	std::uintmax_t oldFileSize;
+	std::uintmax_t newFileSize;
+	// Hash of the new file, unused for removed files
+	std::uint64_t newFileHash;
+};
+
+inline const char* toString(DirectoryFileStatus status)
+{
+	switch (status)
+	{
+	case DirectoryFileStatus::unchanged:
+		return "unchanged";
+	case DirectoryFileStatus::patched:
+		return "patched";
+	case DirectoryFileStatus::added:
+		return "added";
+	case DirectoryFileStatus::removed:
+		return "removed";
+	}
+	throw std::invalid_argument{ "Unknown directory file status" };
+}
+
+inline std::uint64_t hashFile(const std::filesystem::path& fileName)
+{
+	return hash64(MappedFile{ fileName });
+}
+
+// Relative paths of the regular files under a directory, sorted
+inline std::vector<std::filesystem::path> listFiles(const std::filesystem::path& directory)
+{
+	auto files = std::vector<std::filesystem::path>{};
+	for (const auto& item : std::filesystem::recursive_directory_iterator{ directory })
+	{
+		if (item.is_regular_file())
+		{
+			files.push_back(item.path().lexically_relative(directory));
+		}
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+// Files with the same size are compared by hash, so only the new files and the old files of the same size are read
+inline std::vector<DirectoryFile> pairDirectoryFiles(const std::filesystem::path& oldDirectory, const std::filesystem::path& newDirectory)
+{
+	const auto oldFiles = listFiles(oldDirectory);
+	const auto newFiles = listFiles(newDirectory);
+	auto result = std::vector<DirectoryFile>{};
+	auto oldFile = oldFiles.begin();
+	for (const auto& newFile : newFiles)
+	{
+		for (; oldFile != oldFiles.end() && *oldFile < newFile; ++oldFile)
+		{
+			result.push_back(DirectoryFile{ *oldFile, DirectoryFileStatus::removed, std::filesystem::file_size(oldDirectory / *oldFile), 0, 0 });
+		}
+		const auto newFileSize = std::filesystem::file_size(newDirectory / newFile);
+		const auto newFileHash = hashFile(newDirectory / newFile);
+		if (oldFile == oldFiles.end() || *oldFile != newFile)
+		{
+			result.push_back(DirectoryFile{ newFile, DirectoryFileStatus::added, 0, newFileSize, newFileHash });
+			continue;
+		}
+		const auto oldFileSize = std::filesystem::file_size(oldDirectory / *oldFile);
+		const auto unchanged = oldFileSize == newFileSize && hashFile(oldDirectory / *oldFile) == newFileHash;
+		// Nothing can be copied from an empty old file, so the new file is shipped as it is
+		const auto status = unchanged ? DirectoryFileStatus::unchanged : oldFileSize == 0 ? DirectoryFileStatus::added : DirectoryFileStatus::patched;
+		result.push_back(DirectoryFile{ newFile, status, oldFileSize, newFileSize, newFileHash });
+		++oldFile;
+	}
+	for (; oldFile != oldFiles.end(); ++oldFile)
+	{
+		result.push_back(DirectoryFile{ *oldFile, DirectoryFileStatus::removed, std::filesystem::file_size(oldDirectory / *oldFile), 0, 0 });
+	}
+	return result;
+}
+
+// One line per file: status, relative path (with forward slashes), and for files of the new directory, their size and hash,
+// separated by tabs
+inline void writeDirectoryManifest(const std::filesystem::path& fileName, const std::vector<DirectoryFile>& files)
+{
+	auto manifest = std::ofstream{ fileName, std::ofstream::binary };
+	manifest.exceptions(manifest.exceptions() | manifest.badbit | manifest.failbit);
+	manifest << "ARPatcher directory manifest 1\n";
+	for (const auto& file : files)
+	{
+		manifest << toString(file.status) << '\t' << file.relativePath.generic_string();
+		if (file.status != DirectoryFileStatus::removed)
+		{
+			manifest << '\t' << file.newFileSize << '\t' << toHexString(file.newFileHash);
+		}
+		manifest << '\n';
+	}
+}
\ No newline at end of file
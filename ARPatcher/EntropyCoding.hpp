@@ -0,0 +1,268 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+// LEB128 style variable length integers: 7 bits per byte, lowest bits first
+inline void appendVarint(std::vector<std::uint8_t>& out, std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<std::uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<std::uint8_t>(value));
+}
+
+inline std::uint64_t readVarint(const std::uint8_t*& data, const std::uint8_t* end)
+{
+	auto value = std::uint64_t{ 0 };
+	for (auto shift = 0; shift < 64; shift += 7)
+	{
+		if (data == end)
+		{
+			throw std::runtime_error{ "Truncated varint" };
+		}
+		auto byte = *data++;
+		value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+	throw std::runtime_error{ "Invalid varint" };
+}
+
+inline void writeVarint(std::ostream& out, std::uint64_t value)
+{
+	auto bytes = std::vector<std::uint8_t>{};
+	appendVarint(bytes, value);
+	out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+inline std::uint64_t readVarint(std::istream& in)
+{
+	auto value = std::uint64_t{ 0 };
+	for (auto shift = 0; shift < 64; shift += 7)
+	{
+		auto byte = in.get();
+		if (byte == std::istream::traits_type::eof())
+		{
+			throw std::runtime_error{ "Unexpected end of file" };
+		}
+		value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+	throw std::runtime_error{ "Invalid varint" };
+}
+
+// Number of bytes written by appendVarint
+inline std::size_t varintSize(std::uint64_t value)
+{
+	auto size = std::size_t{ 1 };
+	for (; value >= 0x80; value >>= 7)
+	{
+		++size;
+	}
+	return size;
+}
+
+// Maps signed values to unsigned ones so small magnitudes stay small: 0, -1, 1, -2... -> 0, 1, 2, 3...
+inline std::uint64_t zigzagEncode(std::int64_t value)
+{
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t zigzagDecode(std::uint64_t value)
+{
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+// Order 0 byte-wise rANS (after Fabian Giesen's rans_byte.h), one static frequency table per block.
+// An encoded block is: varint raw size, mode byte, and then either the raw bytes (mode 0),
+// or the frequency table, varint encoded size and the rANS stream (mode 1).
+class RansCoder
+{
+public:
+	static std::vector<std::uint8_t> encode(const std::uint8_t* data, std::size_t size)
+	{
+		auto result = std::vector<std::uint8_t>{};
+		appendVarint(result, size);
+		if (size == 0)
+		{
+			return result;
+		}
+
+		auto counts = std::array<std::uint64_t, 256>{};
+		for (auto i = std::size_t{ 0 }; i < size; ++i)
+		{
+			++counts[data[i]];
+		}
+		const auto frequencies = normalize(counts, size);
+		auto starts = std::array<std::uint32_t, 256>{};
+		for (auto symbol = 1; symbol < 256; ++symbol)
+		{
+			starts[symbol] = starts[symbol - 1] + frequencies[symbol - 1];
+		}
+
+		// The stream is produced backwards, so the decoder can read it forwards.
+		// A symbol never takes more than scaleBits bits.
+		auto stream = std::vector<std::uint8_t>(size * 2 + 16);
+		auto pointer = stream.data() + stream.size();
+		auto state = lowerBound;
+		for (auto i = size; i-- > 0;)
+		{
+			const auto frequency = frequencies[data[i]];
+			const auto maximum = ((lowerBound >> scaleBits) << 8) * frequency;
+			while (state >= maximum)
+			{
+				*--pointer = static_cast<std::uint8_t>(state & 0xFF);
+				state >>= 8;
+			}
+			state = ((state / frequency) << scaleBits) + (state % frequency) + starts[data[i]];
+		}
+		for (auto i = 0; i < 4; ++i)
+		{
+			*--pointer = static_cast<std::uint8_t>(state >> (i * 8));
+		}
+		const auto encodedSize = static_cast<std::size_t>(stream.data() + stream.size() - pointer);
+
+		auto table = std::vector<std::uint8_t>{};
+		for (auto frequency : frequencies)
+		{
+			appendVarint(table, frequency);
+		}
+		if (table.size() + encodedSize + 8 >= size)
+		{
+			result.push_back(storedMode);
+			result.insert(result.end(), data, data + size);
+			return result;
+		}
+		result.push_back(ransMode);
+		result.insert(result.end(), table.begin(), table.end());
+		appendVarint(result, encodedSize);
+		result.insert(result.end(), pointer, pointer + encodedSize);
+		return result;
+	}
+
+	// Decodes one block starting at data, and advances data past it
+	static std::vector<std::uint8_t> decode(const std::uint8_t*& data, const std::uint8_t* end)
+	{
+		const auto size = readVarint(data, end);
+		auto result = std::vector<std::uint8_t>{};
+		if (size == 0)
+		{
+			return result;
+		}
+		if (data == end)
+		{
+			throw std::runtime_error{ "Truncated entropy coded block" };
+		}
+		const auto mode = *data++;
+		if (mode == storedMode)
+		{
+			if (static_cast<std::uint64_t>(end - data) < size)
+			{
+				throw std::runtime_error{ "Truncated entropy coded block" };
+			}
+			result.assign(data, data + size);
+			data += size;
+			return result;
+		}
+		if (mode != ransMode)
+		{
+			throw std::runtime_error{ "Unknown entropy coding mode" };
+		}
+
+		auto frequencies = std::array<std::uint32_t, 256>{};
+		auto starts = std::array<std::uint32_t, 256>{};
+		auto symbols = std::vector<std::uint8_t>(probabilityScale);
+		auto total = std::uint32_t{ 0 };
+		for (auto symbol = 0; symbol < 256; ++symbol)
+		{
+			frequencies[symbol] = static_cast<std::uint32_t>(readVarint(data, end));
+			starts[symbol] = total;
+			if (frequencies[symbol] > probabilityScale - total)
+			{
+				throw std::runtime_error{ "Invalid entropy coding frequency table" };
+			}
+			std::fill_n(symbols.begin() + total, frequencies[symbol], static_cast<std::uint8_t>(symbol));
+			total += frequencies[symbol];
+		}
+		if (total != probabilityScale)
+		{
+			throw std::runtime_error{ "Invalid entropy coding frequency table" };
+		}
+
+		const auto encodedSize = readVarint(data, end);
+		if (encodedSize < 4 || static_cast<std::uint64_t>(end - data) < encodedSize)
+		{
+			throw std::runtime_error{ "Truncated entropy coded block" };
+		}
+		auto pointer = data;
+		const auto streamEnd = data + encodedSize;
+		data = streamEnd;
+
+		auto state = std::uint32_t{ 0 };
+		for (auto i = 0; i < 4; ++i)
+		{
+			state = state << 8 | *pointer++;
+		}
+		result.resize(static_cast<std::size_t>(size));
+		for (auto& byte : result)
+		{
+			const auto slot = state & (probabilityScale - 1);
+			const auto symbol = symbols[slot];
+			byte = symbol;
+			state = frequencies[symbol] * (state >> scaleBits) + slot - starts[symbol];
+			while (state < lowerBound)
+			{
+				if (pointer == streamEnd)
+				{
+					throw std::runtime_error{ "Corrupted entropy coded block" };
+				}
+				state = state << 8 | *pointer++;
+			}
+		}
+		return result;
+	}
+
+private:
+	static constexpr std::uint32_t scaleBits = 14;
+	static constexpr std::uint32_t probabilityScale = 1u << scaleBits;
+	static constexpr std::uint32_t lowerBound = 1u << 23;
+	static constexpr std::uint8_t storedMode = 0;
+	static constexpr std::uint8_t ransMode = 1;
+
+	// Scales the counts so they sum up to probabilityScale, keeping every present symbol at least 1
+	static std::array<std::uint32_t, 256> normalize(const std::array<std::uint64_t, 256>& counts, std::size_t total)
+	{
+		auto frequencies = std::array<std::uint32_t, 256>{};
+		auto sum = std::int64_t{ 0 };
+		for (auto symbol = 0; symbol < 256; ++symbol)
+		{
+			if (counts[symbol] != 0)
+			{
+				frequencies[symbol] = std::max<std::uint32_t>(1, static_cast<std::uint32_t>(counts[symbol] * probabilityScale / total));
+				sum += frequencies[symbol];
+			}
+		}
+		for (; sum < probabilityScale; ++sum)
+		{
+			++*std::max_element(frequencies.begin(), frequencies.end());
+		}
+		for (; sum > probabilityScale; --sum)
+		{
+			--*std::max_element(frequencies.begin(), frequencies.end());
+		}
+		return frequencies;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <string>
+
+// XXH64 (https://github.com/Cyan4973/xxHash), streaming variant.
+// Input words are read as little endian, which is what every platform we ship on uses.
+class XXHash64
+{
+public:
+	explicit XXHash64(std::uint64_t seed = 0) :
+		accumulators{ seed + prime1 + prime2, seed + prime2, seed, seed - prime1 },
+		seed{ seed }
+	{}
+
+	void update(const void* input, std::size_t size)
+	{
+		auto bytes = static_cast<const std::uint8_t*>(input);
+		totalSize += size;
+
+		if (bufferSize + size < buffer.size())
+		{
+			std::memcpy(buffer.data() + bufferSize, bytes, size);
+			bufferSize += size;
+			return;
+		}
+
+		if (bufferSize != 0)
+		{
+			auto fill = buffer.size() - bufferSize;
+			std::memcpy(buffer.data() + bufferSize, bytes, fill);
+			consumeStripe(buffer.data());
+			bytes += fill;
+			size -= fill;
+			bufferSize = 0;
+		}
+
+		for (; size >= buffer.size(); bytes += buffer.size(), size -= buffer.size())
+		{
+			consumeStripe(bytes);
+		}
+
+		std::memcpy(buffer.data(), bytes, size);
+		bufferSize = size;
+	}
+
+	std::uint64_t digest() const
+	{
+		auto hash = std::uint64_t{};
+		if (totalSize >= buffer.size())
+		{
+			hash = rotateLeft(accumulators[0], 1) + rotateLeft(accumulators[1], 7)
+				+ rotateLeft(accumulators[2], 12) + rotateLeft(accumulators[3], 18);
+			for (auto accumulator : accumulators)
+			{
+				hash = (hash ^ round(0, accumulator)) * prime1 + prime4;
+			}
+		}
+		else
+		{
+			hash = seed + prime5;
+		}
+		hash += totalSize;
+
+		auto i = std::size_t{ 0 };
+		for (; i + 8 <= bufferSize; i += 8)
+		{
+			hash ^= round(0, read64(buffer.data() + i));
+			hash = rotateLeft(hash, 27) * prime1 + prime4;
+		}
+		if (i + 4 <= bufferSize)
+		{
+			hash ^= read32(buffer.data() + i) * prime1;
+			hash = rotateLeft(hash, 23) * prime2 + prime3;
+			i += 4;
+		}
+		for (; i < bufferSize; ++i)
+		{
+			hash ^= buffer[i] * prime5;
+			hash = rotateLeft(hash, 11) * prime1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= prime2;
+		hash ^= hash >> 29;
+		hash *= prime3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+private:
+	static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+	static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+	static constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+	static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+	static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+	static constexpr std::uint64_t rotateLeft(std::uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	static constexpr std::uint64_t round(std::uint64_t accumulator, std::uint64_t input)
+	{
+		return rotateLeft(accumulator + input * prime2, 31) * prime1;
+	}
+
+	static std::uint64_t read64(const std::uint8_t* bytes)
+	{
+		auto value = std::uint64_t{};
+		std::memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	static std::uint64_t read32(const std::uint8_t* bytes)
+	{
+		auto value = std::uint32_t{};
+		std::memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	void consumeStripe(const std::uint8_t* stripe)
+	{
+		for (auto i = std::size_t{ 0 }; i < accumulators.size(); ++i)
+		{
+			accumulators[i] = round(accumulators[i], read64(stripe + i * 8));
+		}
+	}
+
+	std::array<std::uint64_t, 4> accumulators;
+	std::array<std::uint8_t, 32> buffer{};
+	std::size_t bufferSize = 0;
+	std::uint64_t totalSize = 0;
+	std::uint64_t seed;
+};
+
+template<typename Container>
+std::uint64_t hash64(const Container& data, std::uint64_t seed = 0)
+{
+	auto hash = XXHash64{ seed };
+	hash.update(data.data(), data.size() * sizeof(*data.data()));
+	return hash.digest();
+}
+
+inline std::string toHexString(std::uint64_t value)
+{
+	constexpr auto digits = "0123456789abcdef";
+	auto result = std::string(16, '0');
+	for (auto i = result.rbegin(); i != result.rend(); ++i, value >>= 4)
+	{
+		*i = digits[value & 0xF];
+	}
+	return result;
+}
\ No newline at end of file
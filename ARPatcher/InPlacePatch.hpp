@@ -0,0 +1,371 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "MappedPatch.hpp"
+#include "Utilities.hpp"
+#include "Instrumentation.hpp"
+
+// Rebuilds the new file over the old file, without a second copy of it on disk.
+// The chunks are first turned into operations on raw (unescaped) offsets: copies within the old file, literal bytes,
+// and copies from the reference files of multi-reference index files, which aren't modified.
+// A copy must run before any copy whose target overlaps its source, so the copies are sorted topologically;
+// when the remaining ones form cycles, the shortest remaining copy is read into memory (spilled) and written like literal bytes.
+// Everything is read from the old file before anything is written, so spilling is always possible.
+struct InPlaceOperation
+{
+	enum class Kind
+	{
+		copy,
+		literal,
+		external
+	};
+
+	Kind kind;
+	// Offset in the new file
+	std::uint64_t target;
+	std::uint64_t length;
+	// Offset in the old file (copy), or in the literal bytes of the schedule (literal)
+	std::uint64_t source;
+	// Bytes of a reference file (external)
+	const std::uint8_t* external;
+};
+
+class InPlaceSchedule
+{
+public:
+	void addCopy(std::uint64_t source, std::uint64_t length)
+	{
+		if (operations.empty() == false && operations.back().kind == InPlaceOperation::Kind::copy
+			&& operations.back().source + operations.back().length == source)
+		{
+			operations.back().length += length;
+		}
+		else
+		{
+			operations.push_back(InPlaceOperation{ InPlaceOperation::Kind::copy, newSize, length, source, nullptr });
+		}
+		newSize += length;
+	}
+
+	void addLiteral(const std::uint8_t* data, std::size_t length)
+	{
+		if (operations.empty() || operations.back().kind != InPlaceOperation::Kind::literal
+			|| operations.back().source + operations.back().length != literals.size())
+		{
+			operations.push_back(InPlaceOperation{ InPlaceOperation::Kind::literal, newSize, 0, literals.size(), nullptr });
+		}
+		literals.insert(literals.end(), data, data + length);
+		operations.back().length += length;
+		newSize += length;
+	}
+
+	void addExternal(const std::uint8_t* data, std::size_t length)
+	{
+		if (operations.empty() == false && operations.back().kind == InPlaceOperation::Kind::external
+			&& operations.back().external + operations.back().length == data)
+		{
+			operations.back().length += length;
+		}
+		else
+		{
+			operations.push_back(InPlaceOperation{ InPlaceOperation::Kind::external, newSize, length, 0, data });
+		}
+		newSize += length;
+	}
+
+	// Sorts the operations so that no copy overwrites the source of a copy which hasn't run yet:
+	// the copies first, in topological order, then everything else. oldFile must still be unmodified.
+	// Throws if more than maxSpillSize bytes would have to be spilled.
+	void order(const std::uint8_t* oldFile, std::size_t maxSpillSize)
+	{
+		auto copies = std::vector<InPlaceOperation>{};
+		auto others = std::vector<InPlaceOperation>{};
+		for (const auto& operation : operations)
+		{
+			(operation.kind == InPlaceOperation::Kind::copy ? copies : others).push_back(operation);
+		}
+
+		// Copies are still in the order of their targets, which don't overlap. overwritten[u] are the copies whose target
+		// overlaps the source of u, and readerCounts[v] is the number of copies which still have to read the target of v.
+		// A copy which overlaps itself is handled by applyInPlace.
+		auto targetEnds = std::vector<std::uint64_t>{};
+		for (const auto& copy : copies)
+		{
+			targetEnds.push_back(copy.target + copy.length);
+		}
+		auto readerCounts = std::vector<std::size_t>(copies.size(), 0);
+		auto overwritten = std::vector<std::vector<std::uint32_t>>(copies.size());
+		for (auto u = std::size_t{ 0 }; u < copies.size(); ++u)
+		{
+			const auto sourceEnd = copies[u].source + copies[u].length;
+			auto v = static_cast<std::size_t>(std::upper_bound(targetEnds.begin(), targetEnds.end(), copies[u].source) - targetEnds.begin());
+			for (; v < copies.size() && copies[v].target < sourceEnd; ++v)
+			{
+				if (v != u)
+				{
+					overwritten[u].push_back(static_cast<std::uint32_t>(v));
+					++readerCounts[v];
+				}
+			}
+		}
+
+		auto ready = std::vector<std::size_t>{};
+		for (auto v = std::size_t{ 0 }; v < copies.size(); ++v)
+		{
+			if (readerCounts[v] == 0)
+			{
+				ready.push_back(v);
+			}
+		}
+		using Candidate = std::pair<std::uint64_t, std::size_t>;
+		auto shortest = std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>>{};
+		for (auto v = std::size_t{ 0 }; v < copies.size(); ++v)
+		{
+			shortest.emplace(copies[v].length, v);
+		}
+		auto done = std::vector<std::uint8_t>(copies.size(), 0);
+		auto release = [&](std::size_t u) {
+			done[u] = 1;
+			for (auto v : overwritten[u])
+			{
+				if (--readerCounts[v] == 0 && done[v] == 0)
+				{
+					ready.push_back(v);
+				}
+			}
+		};
+
+		auto ordered = std::vector<InPlaceOperation>{};
+		auto spilled = std::vector<InPlaceOperation>{};
+		while (ordered.size() + spilled.size() < copies.size())
+		{
+			if (ready.empty())
+			{
+				while (done[shortest.top().second] != 0)
+				{
+					shortest.pop();
+				}
+				auto u = shortest.top().second;
+				const auto& copy = copies[u];
+				spilledSize += copy.length;
+				if (spilledSize > maxSpillSize)
+				{
+					throw std::runtime_error{ "Applying this index file in place needs to keep more than " + std::to_string(maxSpillSize) + " bytes of the old file in memory" };
+				}
+				spilled.push_back(InPlaceOperation{ InPlaceOperation::Kind::literal, copy.target, copy.length, literals.size(), nullptr });
+				literals.insert(literals.end(), oldFile + copy.source, oldFile + copy.source + copy.length);
+				release(u);
+				continue;
+			}
+			auto u = ready.back();
+			ready.pop_back();
+			if (done[u] != 0)
+			{
+				continue;
+			}
+			ordered.push_back(copies[u]);
+			release(u);
+		}
+
+		ordered.insert(ordered.end(), spilled.begin(), spilled.end());
+		ordered.insert(ordered.end(), others.begin(), others.end());
+		operations = std::move(ordered);
+	}
+
+	const std::vector<InPlaceOperation>& getOperations() const
+	{
+		return operations;
+	}
+
+	const std::vector<std::uint8_t>& getLiterals() const
+	{
+		return literals;
+	}
+
+	std::uint64_t newFileSize() const
+	{
+		return newSize;
+	}
+
+	std::uint64_t spilledBytes() const
+	{
+		return spilledSize;
+	}
+
+private:
+	std::vector<InPlaceOperation> operations;
+	std::vector<std::uint8_t> literals;
+	std::uint64_t newSize = 0;
+	std::uint64_t spilledSize = 0;
+};
+
+// Writer for writeChunkFromRaw which adds the chunks to an InPlaceSchedule instead of writing them:
+// raw bytes of the old file become copies, escaped bytes are unescaped into literal bytes
+class InPlaceScheduleWriter
+{
+public:
+	InPlaceScheduleWriter(InPlaceSchedule& schedule, const SourceFile& oldFile, const EscapeTable& table) :
+		schedule{ &schedule },
+		oldFile{ oldFile },
+		table{ &table }
+	{}
+
+	void write(const std::uint8_t* data, std::size_t size)
+	{
+		const auto end = data + size;
+		if (pendingEscape && data < end)
+		{
+			const auto byte = table->decode(*data++);
+			schedule->addLiteral(&byte, 1);
+			pendingEscape = false;
+		}
+		while (data < end)
+		{
+			auto escape = std::find(data, end, table->escapeByte());
+			if (data < escape)
+			{
+				schedule->addLiteral(data, static_cast<std::size_t>(escape - data));
+			}
+			if (escape == end)
+			{
+				break;
+			}
+			if (escape + 1 == end)
+			{
+				pendingEscape = true;
+				break;
+			}
+			const auto byte = table->decode(escape[1]);
+			schedule->addLiteral(&byte, 1);
+			data = escape + 2;
+		}
+	}
+
+	void writeRaw(const std::uint8_t* data, std::size_t size)
+	{
+		if (pendingEscape)
+		{
+			throw std::logic_error{ "Raw bytes can't follow an incomplete escape sequence" };
+		}
+		if (size == 0)
+		{
+			return;
+		}
+		if (data >= oldFile.data && data < oldFile.data + oldFile.size)
+		{
+			schedule->addCopy(static_cast<std::uint64_t>(data - oldFile.data), size);
+			return;
+		}
+		schedule->addExternal(data, size);
+	}
+
+	bool pending() const
+	{
+		return pendingEscape;
+	}
+
+	void finish() const
+	{
+		if (pendingEscape)
+		{
+			throw std::runtime_error{ "Truncated escape sequence at the end of file, corrupted index file?" };
+		}
+	}
+
+private:
+	InPlaceSchedule* schedule;
+	SourceFile oldFile;
+	const EscapeTable* table;
+	bool pendingEscape = false;
+};
+
+// oldFiles.front() is the old file, which must stay unmodified until the schedule is returned.
+// Copies are recognized by their address, so every old file must be in memory.
+template<typename NextChunk>
+InPlaceSchedule planInPlacePatch(const std::vector<SourceFile>& oldFiles, const EscapeData& escapeData, NextChunk nextChunk, std::size_t maxSpillSize)
+{
+	if (std::any_of(oldFiles.begin(), oldFiles.end(), [](const SourceFile& file) { return file.data == nullptr && file.size > 0; }))
+	{
+		throw std::invalid_argument{ "In-place patching needs the old files in memory" };
+	}
+	const auto table = EscapeTable{ escapeData };
+	const auto sources = EscapedSources{ oldFiles, table };
+	auto schedule = InPlaceSchedule{};
+	auto writer = InPlaceScheduleWriter{ schedule, oldFiles.front(), table };
+	while (const auto* chunk = nextChunk())
+	{
+		writeChunkFromRaw(writer, *chunk, table, sources);
+	}
+	writer.finish();
+	schedule.order(oldFiles.front().data, maxSpillSize);
+	return schedule;
+}
+
+// Runs the operations of an ordered schedule on the old file, which becomes the new file.
+// The file is resized first when the new file is larger, and last when it's smaller.
+template<typename ShowProgress = decltype(voidNoOperation)>
+void applyInPlace(const std::filesystem::path& fileName, const InPlaceSchedule& schedule, std::size_t bufferSize, ShowProgress showProgress = voidNoOperation)
+{
+	const auto oldSize = std::filesystem::file_size(fileName);
+	if (schedule.newFileSize() > oldSize)
+	{
+		std::filesystem::resize_file(fileName, schedule.newFileSize());
+	}
+
+	{
+		auto file = std::fstream{ fileName, std::fstream::in | std::fstream::out | std::fstream::binary };
+		file.exceptions(file.exceptions() | file.badbit | file.failbit);
+		auto buffer = std::vector<char>(std::max<std::size_t>(bufferSize, 1));
+		auto writeAt = [&file](std::uint64_t position, const void* data, std::size_t size) {
+			file.seekp(static_cast<std::streamoff>(position));
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		};
+		for (const auto& operation : schedule.getOperations())
+		{
+			switch (operation.kind)
+			{
+			case InPlaceOperation::Kind::copy:
+			{
+				if (operation.source == operation.target)
+				{
+					break;
+				}
+				// A copy overlapping itself towards the end of the file is done backwards, so it never overwrites bytes it still has to read
+				const auto backwards = operation.target > operation.source && operation.target < operation.source + operation.length;
+				for (auto done = std::uint64_t{ 0 }; done < operation.length;)
+				{
+					const auto count = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), operation.length - done));
+					const auto offset = backwards ? operation.length - done - count : done;
+					file.seekg(static_cast<std::streamoff>(operation.source + offset));
+					file.read(buffer.data(), static_cast<std::streamsize>(count));
+					writeAt(operation.target + offset, buffer.data(), count);
+					done += count;
+				}
+				break;
+			}
+			case InPlaceOperation::Kind::literal:
+				writeAt(operation.target, schedule.getLiterals().data() + operation.source, static_cast<std::size_t>(operation.length));
+				break;
+			case InPlaceOperation::Kind::external:
+				writeAt(operation.target, operation.external, static_cast<std::size_t>(operation.length));
+				break;
+			}
+			countEvents(Counter::bytesWritten, operation.length);
+			showProgress(static_cast<std::size_t>(operation.length));
+		}
+		file.flush();
+	}
+
+	if (schedule.newFileSize() < oldSize)
+	{
+		std::filesystem::resize_file(fileName, schedule.newFileSize());
+	}
+}
\ No newline at end of file
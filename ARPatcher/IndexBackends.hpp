@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Suffix indices the old file sections can be searched with, fastest first
+enum class IndexBackend {
+	// Uncompressed suffix array, built with divsufsort; sections are limited to 2 GiB
+	suffixArray,
+	// cst_sct3 with every suffix array value sampled, so finding the position of a node doesn't walk the wavelet tree
+	denseCst,
+	// cst_sct3<> with the default sampling
+	cst,
+	// cst_sada<>, whose LCP values take 2 bits per byte but are computed from the CSA
+	sadaCst
+};
+
+constexpr auto indexBackends = std::array<IndexBackend, 4>{ IndexBackend::suffixArray, IndexBackend::denseCst, IndexBackend::cst, IndexBackend::sadaCst };
+
+inline std::string toString(IndexBackend backend)
+{
+	switch (backend)
+	{
+	case IndexBackend::suffixArray:
+		return "suffixArray";
+	case IndexBackend::denseCst:
+		return "denseCst";
+	case IndexBackend::cst:
+		return "cst";
+	case IndexBackend::sadaCst:
+		return "sadaCst";
+	}
+	throw std::logic_error{ "Unknown index backend" };
+}
+
+// Rough memory usage of a backend, in bytes per escaped byte of the old file
+struct IndexBackendCost
+{
+	// Kept while searching: the escaped sections and their indices
+	double searchBytesPerByte;
+	// Additional peak while constructing the index of a section
+	double constructionBytesPerByte;
+	// Largest section the backend can index
+	std::size_t maxSectionSize;
+};
+
+inline IndexBackendCost indexBackendCost(IndexBackend backend)
+{
+	constexpr auto unlimited = std::numeric_limits<std::size_t>::max();
+	switch (backend)
+	{
+	case IndexBackend::suffixArray:
+		// 32 bit suffix array, divsufsort works in place
+		return IndexBackendCost{ 5, 0, static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max()) };
+	case IndexBackend::denseCst:
+		// About log2(n) bits more per byte than cst for the suffix array samples
+		return IndexBackendCost{ 8, 20, unlimited };
+	case IndexBackend::cst:
+		return IndexBackendCost{ 5, 20, unlimited };
+	case IndexBackend::sadaCst:
+		return IndexBackendCost{ 4, 20, unlimited };
+	}
+	throw std::logic_error{ "Unknown index backend" };
+}
+
+// Estimated peak memory usage of generating an index file: the old file, the new file and the escaped new file are kept in memory,
+// along with the indices of the old file, and up to concurrentConstructions sections as large as the largest one need the construction
+// memory of their backend at the same time. -bigArchive also keeps the indices of the changed old entries, which together are
+// at most as large as the indices of the whole old file.
+inline std::size_t estimateGenerateMemory(std::uintmax_t oldFileSize, std::uintmax_t newFileSize, std::size_t maxSingleBufferSize,
+	IndexBackend backend = IndexBackend::cst, std::size_t concurrentConstructions = 1, bool bigArchive = false)
+{
+	const auto cost = indexBackendCost(backend);
+	const auto largestSection = std::min<std::uintmax_t>(oldFileSize, maxSingleBufferSize);
+	const auto indices = cost.searchBytesPerByte * oldFileSize * (bigArchive ? 2 : 1);
+	return static_cast<std::size_t>(indices + 2 * newFileSize + cost.constructionBytesPerByte * largestSection * std::max<std::size_t>(concurrentConstructions, 1));
+}
+
+// Most sections, up to maxConcurrentConstructions, which can be constructed at the same time within memoryBudget; at least 1
+inline std::size_t concurrentConstructionsWithin(std::size_t memoryBudget, std::uintmax_t oldFileSize, std::uintmax_t newFileSize,
+	std::size_t maxSingleBufferSize, IndexBackend backend, std::size_t maxConcurrentConstructions, bool bigArchive)
+{
+	auto count = std::max<std::size_t>(maxConcurrentConstructions, 1);
+	while (count > 1 && estimateGenerateMemory(oldFileSize, newFileSize, maxSingleBufferSize, backend, count, bigArchive) > memoryBudget)
+	{
+		--count;
+	}
+	return count;
+}
+
+struct IndexBackendChoice
+{
+	IndexBackend backend;
+	std::size_t maxSingleBufferSize;
+};
+
+// Smaller sections would split the old file too much to be worth it
+constexpr auto minimumBudgetSectionSize = std::size_t{ 1024 * 1024 };
+
+// First of candidates (fastest first) whose estimated memory usage fits memoryBudget with sections of maxSingleBufferSize bytes,
+// constructed one at a time. When none fits, the one allowing the largest sections is chosen and they're cut down to fit;
+// nullopt if even 1 MiB sections don't fit.
+inline std::optional<IndexBackendChoice> chooseIndexBackend(std::size_t memoryBudget, std::uintmax_t oldFileSize, std::uintmax_t newFileSize,
+	std::size_t maxSingleBufferSize, const std::vector<IndexBackend>& candidates, bool bigArchive = false)
+{
+	auto best = std::optional<IndexBackendChoice>{};
+	for (auto candidate : candidates)
+	{
+		const auto cost = indexBackendCost(candidate);
+		const auto sectionSize = static_cast<std::size_t>(std::min<std::uintmax_t>(oldFileSize, maxSingleBufferSize));
+		if (sectionSize <= cost.maxSectionSize && estimateGenerateMemory(oldFileSize, newFileSize, sectionSize, candidate, 1, bigArchive) <= memoryBudget)
+		{
+			return IndexBackendChoice{ candidate, maxSingleBufferSize };
+		}
+
+		const auto searchMemory = cost.searchBytesPerByte * oldFileSize * (bigArchive ? 2 : 1) + 2 * newFileSize;
+		if (searchMemory >= memoryBudget)
+		{
+			continue;
+		}
+		auto largestSection = std::min(sectionSize, cost.maxSectionSize);
+		if (cost.constructionBytesPerByte > 0)
+		{
+			largestSection = std::min(largestSection, static_cast<std::size_t>((memoryBudget - searchMemory) / cost.constructionBytesPerByte));
+		}
+		if (largestSection >= std::min(minimumBudgetSectionSize, sectionSize) && (best.has_value() == false || largestSection > best->maxSingleBufferSize))
+		{
+			best = IndexBackendChoice{ candidate, largestSection };
+		}
+	}
+	return best;
+}
\ No newline at end of file
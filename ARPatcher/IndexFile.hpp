@@ -0,0 +1,410 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <istream>
+#include <iterator>
+#include <numeric>
+#include <memory>
+#include <streambuf>
+#include <ostream>
+#include <fstream>
+#include <filesystem>
+#include <PatchData.hpp>
+#include "WidePatchData.hpp"
+#include "Utilities.hpp"
+#include "Checksums.hpp"
+#include "EntropyCoding.hpp"
+#include "CompactChunks.hpp"
+#include "ColumnarIndex.hpp"
+#include "MappedFile.hpp"
+
+// Index files start with a small header of our own. In version 1, it's followed by the PatchData serialized by ARPatcherData;
+// version 2 (compact) stores the file names, the escape byte and the escaped size of the new file itself, followed by the chunks encoded by CompactChunkWriter;
+// version 3 (columnar) has the same fields, followed by the chunks encoded by ColumnarIndex.
+// Index files without the header (generated by older versions) are still accepted.
+// Only versions 2 and 3 can store the 64 bit offsets needed by files larger than 4 GiB, and the additional old files
+// of multi-reference index files (a varint count, then the name, size and hash of every file, after the escape data).
+constexpr auto indexFileMagic = std::array<char, 4>{ 'A', 'R', 'P', 'X' };
+constexpr auto latestIndexFileVersion = std::uint32_t{ 3 };
+
+enum class IndexFormat
+{
+	patchData = 1,
+	compact = 2,
+	columnar = 3
+};
+
+struct IndexFile
+{
+	// 0 for index files without header
+	std::uint32_t version = 0;
+	std::optional<ContentChecksums> checksums;
+	WidePatchData patchData;
+};
+
+// Flags of the index file header
+constexpr auto hasContentChecksums = std::uint32_t{ 1 };
+constexpr auto hasReferenceFiles = std::uint32_t{ 2 };
+constexpr auto knownIndexFileFlags = hasContentChecksums | hasReferenceFiles;
+
+inline void writeIndexString(std::ostream& out, const std::string& value)
+{
+	writeVarint(out, value.size());
+	out.write(value.data(), value.size());
+}
+
+inline std::string readIndexString(std::istream& in)
+{
+	auto value = std::string(static_cast<std::size_t>(readVarint(in)), '\0');
+	if (in.read(value.data(), value.size()).gcount() != static_cast<std::streamsize>(value.size()))
+	{
+		throw std::runtime_error{ "Unexpected end of index file" };
+	}
+	return value;
+}
+
+inline std::uint64_t escapedNewFileSize(const std::vector<WideDataChunk>& chunks)
+{
+	return std::accumulate(chunks.begin(), chunks.end(), std::uint64_t{ 0 }, [](std::uint64_t sum, const WideDataChunk& chunk) {
+		return sum + chunk.length;
+	});
+}
+
+inline void writeIndexFile(std::ostream& out, WidePatchData patchData, const std::optional<ContentChecksums>& checksums, IndexFormat format = IndexFormat::compact)
+{
+	const auto hasReferences = patchData.referenceFileNames.empty() == false;
+	if (hasReferences && format == IndexFormat::patchData)
+	{
+		throw std::invalid_argument{ "Index files in the PatchData format can't have multiple old files" };
+	}
+	if (hasReferences && checksums.has_value() && checksums->referenceFiles.size() != patchData.referenceFileNames.size())
+	{
+		throw std::invalid_argument{ "Every reference file needs a checksum" };
+	}
+	out.write(indexFileMagic.data(), indexFileMagic.size());
+	writeLittleEndian(out, static_cast<std::uint32_t>(format));
+	writeLittleEndian(out, (checksums.has_value() ? hasContentChecksums : 0) | (hasReferences ? hasReferenceFiles : 0));
+	if (checksums.has_value())
+	{
+		writeLittleEndian(out, checksums->oldFileSize);
+		writeLittleEndian(out, checksums->oldFileHash);
+		writeLittleEndian(out, checksums->newFileSize);
+		writeLittleEndian(out, checksums->newFileHash);
+		writeLittleEndian(out, checksums->blockSize);
+		writeLittleEndian(out, static_cast<std::uint64_t>(checksums->blockHashes.size()));
+		for (auto hash : checksums->blockHashes)
+		{
+			writeLittleEndian(out, hash);
+		}
+	}
+
+	if (format == IndexFormat::patchData)
+	{
+		writeChunks(out, toPatchData(std::move(patchData)));
+		return;
+	}
+	writeIndexString(out, patchData.oldFileName.u8string());
+	writeIndexString(out, patchData.newFileName.u8string());
+	writeLittleEndian(out, static_cast<std::uint8_t>(patchData.escapeData.escape));
+	// Total of the chunks, so applying can report its progress before decoding them
+	writeLittleEndian(out, escapedNewFileSize(patchData.dataChunks));
+	if (hasReferences)
+	{
+		writeVarint(out, patchData.referenceFileNames.size());
+		for (auto i = std::size_t{ 0 }; i < patchData.referenceFileNames.size(); ++i)
+		{
+			// Unknown without checksums
+			const auto checksum = checksums.has_value() ? checksums->referenceFiles[i] : FileChecksum{};
+			writeIndexString(out, patchData.referenceFileNames[i].u8string());
+			writeLittleEndian(out, checksum.size);
+			writeLittleEndian(out, checksum.hash);
+		}
+	}
+	if (format == IndexFormat::columnar)
+	{
+		ColumnarIndex::write(out, patchData.dataChunks);
+		return;
+	}
+	auto writer = CompactChunkWriter{ out };
+	for (const auto& chunk : patchData.dataChunks)
+	{
+		writer.add(chunk);
+	}
+	writer.finish();
+}
+
+// Read only stream buffer over bytes in memory
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+	MemoryStreamBuffer(const std::uint8_t* data, std::size_t size)
+	{
+		auto begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+		setg(begin, begin, begin + size);
+	}
+
+protected:
+	pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override
+	{
+		auto base = direction == std::ios_base::beg ? eback() : direction == std::ios_base::cur ? gptr() : egptr();
+		if ((which & std::ios_base::in) == 0 || offset < eback() - base || offset > egptr() - base)
+		{
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), base + offset, egptr());
+		return pos_type(gptr() - eback());
+	}
+
+	pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+	{
+		return seekoff(off_type(position), std::ios_base::beg, which);
+	}
+};
+
+// Reads the header of an index file, and then its chunks one by one.
+// Compact index files are decoded while they're read, so they never have to be entirely in memory;
+// columnar index files are memory mapped, and their chunks can also be accessed directly through columnarChunks().
+class IndexFileReader
+{
+public:
+	explicit IndexFileReader(const std::filesystem::path& indexFileName) :
+		in{ std::make_unique<std::ifstream>(indexFileName, std::ifstream::binary) },
+		description{ indexFileName.string() }
+	{
+		if (static_cast<std::ifstream&>(*in).is_open() == false)
+		{
+			throw std::runtime_error{ "Failed to open index file " + indexFileName.string() };
+		}
+		if (readHeader())
+		{
+			auto columnsOffset = static_cast<std::size_t>(in->tellg());
+			in.reset();
+			mappedIndex.emplace(indexFileName);
+			openColumns(mappedIndex->data(), mappedIndex->size(), columnsOffset);
+		}
+	}
+
+	// Index file in any stream, for example downloaded in memory by a launcher.
+	// The chunks of columnar index files are read into memory, as they can't be memory mapped.
+	explicit IndexFileReader(std::unique_ptr<std::istream> stream, std::string description = "stream") :
+		in{ std::move(stream) },
+		description{ std::move(description) }
+	{
+		if (readHeader())
+		{
+			columnsBuffer.assign(std::istreambuf_iterator<char>{ *in }, std::istreambuf_iterator<char>{});
+			openColumns(columnsBuffer.data(), columnsBuffer.size(), 0);
+		}
+	}
+
+	// Index file in memory, for example memory mapped by the caller, which must stay valid as long as the reader
+	IndexFileReader(const std::uint8_t* data, std::size_t size, std::string description = "buffer") :
+		memoryBuffer{ std::make_unique<MemoryStreamBuffer>(data, size) },
+		in{ std::make_unique<std::istream>(memoryBuffer.get()) },
+		description{ std::move(description) }
+	{
+		if (readHeader())
+		{
+			openColumns(data, size, static_cast<std::size_t>(in->tellg()));
+		}
+	}
+
+	// Chunks of columnar index files point into the reader
+	IndexFileReader(const IndexFileReader&) = delete;
+	IndexFileReader& operator=(const IndexFileReader&) = delete;
+
+	std::uint32_t version() const
+	{
+		return fileVersion;
+	}
+
+	const std::optional<ContentChecksums>& checksums() const
+	{
+		return contentChecksums;
+	}
+
+	// File names and escape data. The chunks of compact and columnar index files are only in patchData().dataChunks after readAllChunks().
+	WidePatchData& patchData()
+	{
+		return *header;
+	}
+
+	// Whether patchData().dataChunks contains the chunks
+	bool chunksLoaded() const
+	{
+		return compactChunks.has_value() == false && columns.has_value() == false;
+	}
+
+	// Chunks of a columnar index file, or nullptr
+	const ColumnarIndex* columnarChunks() const
+	{
+		return columns.has_value() ? &*columns : nullptr;
+	}
+
+	// Total length of the chunks, which are written to the new file before unescaping it; known before the chunks are decoded
+	std::uint64_t escapedNewFileSize() const
+	{
+		return storedEscapedNewFileSize.has_value() ? *storedEscapedNewFileSize : ::escapedNewFileSize(header->dataChunks);
+	}
+
+	// Decodes all the chunks into patchData().dataChunks; call it before nextChunk()
+	void readAllChunks()
+	{
+		if (chunksLoaded() == false)
+		{
+			while (auto chunk = nextChunk())
+			{
+				header->dataChunks.push_back(std::move(*chunk));
+			}
+			compactChunks.reset();
+			columnCursor.reset();
+			columns.reset();
+			mappedIndex.reset();
+			columnsBuffer = {};
+		}
+	}
+
+	// The next chunk, or nullptr after the last one; the chunk stays valid until the next call
+	WideDataChunk* nextChunk()
+	{
+		if (compactChunks.has_value())
+		{
+			return compactChunks->next();
+		}
+		if (columnCursor.has_value())
+		{
+			const auto* view = columnCursor->next();
+			if (view == nullptr)
+			{
+				return nullptr;
+			}
+			auto data = std::vector<std::uint8_t>{};
+			if (isLiteralChunk(*view))
+			{
+				data.assign(view->data, view->data + view->length);
+			}
+			return &current.emplace(view->length, view->sourcePosition, std::move(data));
+		}
+		if (nextChunkIndex == header->dataChunks.size())
+		{
+			return nullptr;
+		}
+		return &header->dataChunks.at(nextChunkIndex++);
+	}
+
+private:
+	// Reads everything before the chunks; returns true for columnar index files, whose chunks start at in->tellg()
+	bool readHeader()
+	{
+		auto magic = std::array<char, 4>{};
+		if (in->read(magic.data(), magic.size()).gcount() != static_cast<std::streamsize>(magic.size()) || magic != indexFileMagic)
+		{
+			in->clear();
+			in->seekg(0);
+			header.emplace(toWidePatchData(readChunks(*in)));
+			return false;
+		}
+
+		fileVersion = readLittleEndian<std::uint32_t>(*in);
+		if (fileVersion == 0 || fileVersion > latestIndexFileVersion)
+		{
+			throw std::runtime_error{ "Index file version " + std::to_string(fileVersion) + " isn't supported by this version" };
+		}
+		auto flags = readLittleEndian<std::uint32_t>(*in);
+		if ((flags & ~knownIndexFileFlags) != 0)
+		{
+			throw std::runtime_error{ "Index file " + description + " uses features which aren't supported by this version" };
+		}
+		if (flags & hasContentChecksums)
+		{
+			auto checksums = ContentChecksums{};
+			checksums.oldFileSize = readLittleEndian<std::uint64_t>(*in);
+			checksums.oldFileHash = readLittleEndian<std::uint64_t>(*in);
+			checksums.newFileSize = readLittleEndian<std::uint64_t>(*in);
+			checksums.newFileHash = readLittleEndian<std::uint64_t>(*in);
+			checksums.blockSize = readLittleEndian<std::uint32_t>(*in);
+			auto blockCount = readLittleEndian<std::uint64_t>(*in);
+			if (checksums.blockSize == 0 || blockCount != (checksums.newFileSize + checksums.blockSize - 1) / checksums.blockSize)
+			{
+				throw std::runtime_error{ "Corrupted checksums in index file " + description };
+			}
+			checksums.blockHashes.resize(static_cast<std::size_t>(blockCount));
+			for (auto& hash : checksums.blockHashes)
+			{
+				hash = readLittleEndian<std::uint64_t>(*in);
+			}
+			contentChecksums = std::move(checksums);
+		}
+
+		if (fileVersion == static_cast<std::uint32_t>(IndexFormat::patchData))
+		{
+			header.emplace(toWidePatchData(readChunks(*in)));
+			return false;
+		}
+		auto oldFileName = std::filesystem::u8path(readIndexString(*in));
+		auto newFileName = std::filesystem::u8path(readIndexString(*in));
+		auto escapeData = EscapeData{};
+		escapeData.escape = readLittleEndian<std::uint8_t>(*in);
+		storedEscapedNewFileSize = readLittleEndian<std::uint64_t>(*in);
+		header.emplace(WidePatchData{ oldFileName, newFileName, escapeData, {} });
+		if (flags & hasReferenceFiles)
+		{
+			const auto count = readVarint(*in);
+			for (auto i = std::uint64_t{ 0 }; i < count; ++i)
+			{
+				header->referenceFileNames.push_back(std::filesystem::u8path(readIndexString(*in)));
+				auto checksum = FileChecksum{};
+				checksum.size = readLittleEndian<std::uint64_t>(*in);
+				checksum.hash = readLittleEndian<std::uint64_t>(*in);
+				if (contentChecksums.has_value())
+				{
+					contentChecksums->referenceFiles.push_back(checksum);
+				}
+			}
+		}
+		if (fileVersion == static_cast<std::uint32_t>(IndexFormat::compact))
+		{
+			compactChunks.emplace(*in);
+			return false;
+		}
+		return true;
+	}
+
+	void openColumns(const std::uint8_t* data, std::size_t size, std::size_t columnsOffset)
+	{
+		if (columnsOffset > size)
+		{
+			throw std::runtime_error{ "Unexpected end of index file" };
+		}
+		columns.emplace(data + columnsOffset, size - columnsOffset);
+		columnCursor.emplace(columns->cursor(0));
+	}
+
+	std::unique_ptr<MemoryStreamBuffer> memoryBuffer;
+	std::unique_ptr<std::istream> in;
+	std::string description;
+	std::vector<std::uint8_t> columnsBuffer;
+	std::uint32_t fileVersion = 0;
+	std::optional<ContentChecksums> contentChecksums;
+	std::optional<WidePatchData> header;
+	// Only in compact and columnar index files, the chunks of the others are always loaded
+	std::optional<std::uint64_t> storedEscapedNewFileSize;
+	std::optional<CompactChunkReader> compactChunks;
+	std::optional<MappedFile> mappedIndex;
+	std::optional<ColumnarIndex> columns;
+	std::optional<ColumnarIndex::Cursor> columnCursor;
+	std::optional<WideDataChunk> current;
+	std::size_t nextChunkIndex = 0;
+};
+
+inline IndexFile readIndexFile(const std::filesystem::path& indexFileName)
+{
+	auto reader = IndexFileReader{ indexFileName };
+	reader.readAllChunks();
+	return IndexFile{ reader.version(), reader.checksums(), std::move(reader.patchData()) };
+}
\ No newline at end of file
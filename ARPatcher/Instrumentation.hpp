@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Hot path counters and wall time of the phases of a run, written as JSON by -statsJson so runs can be compared across releases.
+// Counters are relaxed atomics; hot loops count locally and add their totals once per call.
+enum class Counter
+{
+	cstNodesVisited,
+	csaLookups,
+	bytesCompared,
+	literalChunks,
+	literalBytes,
+	pessimisticEscalations,
+	bytesWritten,
+	sameOffsetMatches,
+	count
+};
+
+class Instrumentation
+{
+public:
+	static Instrumentation& instance()
+	{
+		static auto instance = Instrumentation{};
+		return instance;
+	}
+
+	void add(Counter counter, std::uint64_t value)
+	{
+		counters[static_cast<std::size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+	}
+
+	std::uint64_t get(Counter counter) const
+	{
+		return counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+	}
+
+	// Phases with the same name (for example one per old file section, or one per index file) are added together
+	void addPhase(std::string_view name, double seconds)
+	{
+		auto lock = std::lock_guard{ mutex };
+		auto found = std::find_if(phases.begin(), phases.end(), [name](const Phase& phase) { return phase.name == name; });
+		if (found == phases.end())
+		{
+			phases.push_back(Phase{ std::string{ name }, 0, 0 });
+			found = std::prev(phases.end());
+		}
+		found->seconds += seconds;
+		++found->count;
+	}
+
+	void writeJson(std::ostream& out, std::string_view tool) const
+	{
+		auto lock = std::lock_guard{ mutex };
+		const auto totalSeconds = std::chrono::duration<double>{ std::chrono::steady_clock::now() - startTime }.count();
+		out << std::setprecision(6) << std::fixed;
+		out << "{\n\t\"tool\": \"" << tool << "\",\n\t\"formatVersion\": 1,\n\t\"totalSeconds\": " << totalSeconds << ",\n\t\"phases\": [";
+		for (auto i = std::size_t{ 0 }; i < phases.size(); ++i)
+		{
+			out << (i == 0 ? "\n" : ",\n") << "\t\t{ \"name\": \"" << phases[i].name << "\", \"seconds\": " << phases[i].seconds
+				<< ", \"count\": " << phases[i].count << " }";
+		}
+		out << "\n\t],\n\t\"counters\": {";
+		for (auto i = std::size_t{ 0 }; i < counters.size(); ++i)
+		{
+			out << (i == 0 ? "\n" : ",\n") << "\t\t\"" << counterNames[i] << "\": " << counters[i].load(std::memory_order_relaxed);
+		}
+		out << "\n\t}\n}\n";
+	}
+
+	void writeJson(const std::filesystem::path& fileName, std::string_view tool) const
+	{
+		auto out = std::ofstream{ fileName };
+		out.exceptions(out.exceptions() | out.badbit | out.failbit);
+		writeJson(out, tool);
+	}
+
+private:
+	struct Phase
+	{
+		std::string name;
+		double seconds;
+		std::uint64_t count;
+	};
+
+	static constexpr auto counterCount = static_cast<std::size_t>(Counter::count);
+	static constexpr std::array<const char*, counterCount> counterNames = {
+		"cstNodesVisited",
+		"csaLookups",
+		"bytesCompared",
+		"literalChunks",
+		"literalBytes",
+		"pessimisticEscalations",
+		"bytesWritten",
+		"sameOffsetMatches",
+	};
+
+	Instrumentation() = default;
+
+	std::array<std::atomic<std::uint64_t>, counterCount> counters = {};
+	mutable std::mutex mutex;
+	std::vector<Phase> phases;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+};
+
+inline void countEvents(Counter counter, std::uint64_t value = 1)
+{
+	Instrumentation::instance().add(counter, value);
+}
+
+// Adds the time between its construction and its destruction to a phase
+class ScopedPhase
+{
+public:
+	explicit ScopedPhase(std::string_view name) : name{ name }, begin{ std::chrono::steady_clock::now() } {}
+	ScopedPhase(const ScopedPhase&) = delete;
+	ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+	~ScopedPhase()
+	{
+		Instrumentation::instance().addPhase(name, elapsed());
+	}
+
+	double elapsed() const
+	{
+		return std::chrono::duration<double>{ std::chrono::steady_clock::now() - begin }.count();
+	}
+
+private:
+	std::string_view name;
+	std::chrono::steady_clock::time_point begin;
+};
+
+// Calls function() as a phase and returns its result
+template<typename Function>
+auto measurePhase(std::string_view name, Function function)
+{
+	auto phase = ScopedPhase{ name };
+	return function();
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <filesystem>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of an entire file
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::filesystem::path& path)
+	{
+#ifdef _WIN32
+		file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error{ "Failed to open " + path.string() };
+		}
+		auto fileSize = LARGE_INTEGER{};
+		if (GetFileSizeEx(file, &fileSize) == FALSE)
+		{
+			close();
+			throw std::runtime_error{ "Failed to get the size of " + path.string() };
+		}
+		mappedSize = static_cast<std::size_t>(fileSize.QuadPart);
+		if (mappedSize == 0)
+		{
+			return;
+		}
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+		{
+			mappedData = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		file = ::open(path.c_str(), O_RDONLY);
+		if (file == -1)
+		{
+			throw std::runtime_error{ "Failed to open " + path.string() };
+		}
+		struct stat status = {};
+		if (::fstat(file, &status) != 0)
+		{
+			close();
+			throw std::runtime_error{ "Failed to get the size of " + path.string() };
+		}
+		mappedSize = static_cast<std::size_t>(status.st_size);
+		if (mappedSize == 0)
+		{
+			return;
+		}
+		auto address = ::mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, file, 0);
+		if (address != MAP_FAILED)
+		{
+			mappedData = static_cast<const std::uint8_t*>(address);
+			::madvise(address, mappedSize, MADV_SEQUENTIAL);
+		}
+#endif
+		if (mappedData == nullptr)
+		{
+			close();
+			throw std::runtime_error{ "Failed to map " + path.string() };
+		}
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	const std::uint8_t* data() const
+	{
+		return mappedData;
+	}
+
+	std::size_t size() const
+	{
+		return mappedSize;
+	}
+
+	const std::uint8_t* begin() const
+	{
+		return mappedData;
+	}
+
+	const std::uint8_t* end() const
+	{
+		return mappedData + mappedSize;
+	}
+
+private:
+	void close()
+	{
+#ifdef _WIN32
+		if (mappedData != nullptr)
+		{
+			UnmapViewOfFile(mappedData);
+		}
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+		}
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (mappedData != nullptr)
+		{
+			::munmap(const_cast<std::uint8_t*>(mappedData), mappedSize);
+		}
+		if (file != -1)
+		{
+			::close(file);
+		}
+		file = -1;
+#endif
+		mappedData = nullptr;
+	}
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int file = -1;
+#endif
+	const std::uint8_t* mappedData = nullptr;
+	std::size_t mappedSize = 0;
+};
\ No newline at end of file
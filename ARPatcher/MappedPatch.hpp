@@ -0,0 +1,767 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+#include <ostream>
+#include <Escape.hpp>
+#include "MappedFile.hpp"
+#include "Patch.hpp"
+#include "OutputFile.hpp"
+#include "Checksums.hpp"
+#include "WorkStealingPool.hpp"
+#include "ColumnarIndex.hpp"
+#include "Instrumentation.hpp"
+
+// Byte level view of an escaping scheme, derived from escape() itself:
+// every byte is either kept as is, or replaced by the escape byte followed by a code byte.
+class EscapeTable
+{
+public:
+	explicit EscapeTable(const EscapeData& escapeData) : escapeCharacter{ escapeData.escape }
+	{
+		for (auto value = 0; value < 256; ++value)
+		{
+			auto byte = static_cast<std::uint8_t>(value);
+			auto escaped = escape(std::vector<std::uint8_t>{ byte }, escapeData);
+			if (escaped.size() == 1 && escaped.front() == byte && byte != escapeCharacter)
+			{
+				sizes[byte] = 1;
+			}
+			else if (escaped.size() == 2 && escaped.front() == escapeCharacter && hasCode[escaped.back()] == false)
+			{
+				sizes[byte] = 2;
+				codes[byte] = escaped.back();
+				hasCode[escaped.back()] = true;
+				decoded[escaped.back()] = byte;
+			}
+			else
+			{
+				throw std::runtime_error{ "Unsupported escape data, mapped apply isn't possible" };
+			}
+		}
+	}
+
+	std::uint8_t escapeByte() const
+	{
+		return escapeCharacter;
+	}
+
+	// Number of escaped bytes representing a raw byte
+	std::size_t escapedSize(std::uint8_t byte) const
+	{
+		return sizes[byte];
+	}
+
+	// The byte following the escape byte when a raw byte is escaped
+	std::uint8_t code(std::uint8_t byte) const
+	{
+		return codes[byte];
+	}
+
+	// Raw byte represented by the escape byte followed by code
+	std::uint8_t decode(std::uint8_t code) const
+	{
+		if (hasCode[code] == false)
+		{
+			throw std::runtime_error{ "Invalid escape sequence, corrupted index file / old file?" };
+		}
+		return decoded[code];
+	}
+
+private:
+	std::uint8_t escapeCharacter;
+	std::array<std::uint8_t, 256> sizes = {};
+	std::array<std::uint8_t, 256> codes = {};
+	std::array<std::uint8_t, 256> decoded = {};
+	std::array<bool, 256> hasCode = {};
+};
+
+// A raw old file, either entirely in memory (for example memory mapped), or read piece by piece through read() when data is nullptr
+struct SourceFile
+{
+	const std::uint8_t* data;
+	std::size_t size;
+	// Copies the count bytes at offset to out; called from every thread when the new file is written in parallel
+	std::function<void(std::size_t offset, std::uint8_t* out, std::size_t count)> read;
+};
+
+// Largest piece of a SourceFile without data which is read at once
+constexpr auto sourceFileReadSize = std::size_t{ 64 * 1024 };
+
+inline std::uint8_t readByte(const SourceFile& file, std::size_t offset)
+{
+	if (file.data != nullptr)
+	{
+		return file.data[offset];
+	}
+	auto byte = std::uint8_t{};
+	file.read(offset, &byte, 1);
+	return byte;
+}
+
+// Calls process(bytes, count) for the bytes [offset, offset + length) of file: at once when it's in memory,
+// otherwise in pieces of at most sourceFileReadSize bytes read into a buffer
+template<typename Process>
+void forEachPiece(const SourceFile& file, std::size_t offset, std::size_t length, Process process)
+{
+	if (file.data != nullptr)
+	{
+		process(file.data + offset, length);
+		return;
+	}
+	auto buffer = std::vector<std::uint8_t>(std::min(length, sourceFileReadSize));
+	while (length > 0)
+	{
+		const auto count = std::min(length, buffer.size());
+		file.read(offset, buffer.data(), count);
+		process(buffer.data(), count);
+		offset += count;
+		length -= count;
+	}
+}
+
+// XXHash64 of a whole SourceFile, to check it against the checksums of an index file
+inline std::uint64_t hashSourceFile(const SourceFile& file)
+{
+	auto hash = XXHash64{};
+	forEachPiece(file, 0, file.size, [&hash](const std::uint8_t* bytes, std::size_t count) {
+		hash.update(bytes, count);
+	});
+	return hash.digest();
+}
+
+// Sampled rank of escaped bytes over the raw old file, mapping offsets in the escaped old file to raw offsets.
+// For every block of raw bytes, the number of escaped bytes before it is stored in two levels
+// (64 bits per 64 KiB superblock, 16 bits per 512 bytes block), so the index takes less than 0.5% of the file size
+// and is built in one streaming pass. Resolving an offset is a binary search on blocks plus a scan inside one block.
+class EscapeRankIndex
+{
+public:
+	// An escaped offset: the raw byte whose escaped form contains it, and how many escaped bytes of that form precede it
+	struct Position
+	{
+		std::size_t raw;
+		std::size_t skip;
+	};
+
+	EscapeRankIndex(const SourceFile& rawFile, const EscapeTable& table) :
+		rawFile{ rawFile },
+		table{ &table }
+	{
+		auto escapedBytes = std::uint64_t{ 0 };
+		auto superblockBase = std::uint64_t{ 0 };
+		auto i = std::size_t{ 0 };
+		forEachPiece(rawFile, 0, rawFile.size, [&](const std::uint8_t* bytes, std::size_t count) {
+			for (auto j = std::size_t{ 0 }; j < count; ++j, ++i)
+			{
+				if (i % superblockSize == 0)
+				{
+					superblockBase = escapedBytes;
+					superblocks.push_back(superblockBase);
+				}
+				if (i % blockSize == 0)
+				{
+					blocks.push_back(static_cast<std::uint16_t>(escapedBytes - superblockBase));
+				}
+				escapedBytes += table.escapedSize(bytes[j]) - 1;
+			}
+		});
+		escapedTotal = rawFile.size + static_cast<std::size_t>(escapedBytes);
+	}
+
+	// Size of the escaped old file
+	std::size_t escapedSize() const
+	{
+		return escapedTotal;
+	}
+
+	Position locate(std::size_t escapedOffset) const
+	{
+		if (escapedOffset > escapedTotal)
+		{
+			throw std::out_of_range{ "Escaped offset is outside of the old file, corrupted index file / old file?" };
+		}
+
+		// The last block starting at or before escapedOffset
+		auto low = std::size_t{ 0 };
+		auto high = blocks.size();
+		while (high - low > 1)
+		{
+			auto middle = low + (high - low) / 2;
+			if (blockOffset(middle) <= escapedOffset)
+			{
+				low = middle;
+			}
+			else
+			{
+				high = middle;
+			}
+		}
+
+		// The scan doesn't go past the end of the block
+		auto raw = low * blockSize;
+		auto escaped = blocks.empty() ? std::size_t{ 0 } : blockOffset(low);
+		const auto scannedSize = std::min(blockSize, rawFile.size - raw);
+		auto block = std::array<std::uint8_t, blockSize>{};
+		const auto* bytes = rawFile.data != nullptr ? rawFile.data + raw : block.data();
+		if (rawFile.data == nullptr && scannedSize > 0)
+		{
+			rawFile.read(raw, block.data(), scannedSize);
+		}
+		auto scanned = std::size_t{ 0 };
+		while (scanned < scannedSize && escaped + table->escapedSize(bytes[scanned]) <= escapedOffset)
+		{
+			escaped += table->escapedSize(bytes[scanned]);
+			++scanned;
+		}
+		return Position{ raw + scanned, escapedOffset - escaped };
+	}
+
+private:
+	static constexpr std::size_t superblockSize = 64 * 1024;
+	static constexpr std::size_t blockSize = 512;
+
+	// Escaped offset of the first raw byte of a block
+	std::size_t blockOffset(std::size_t block) const
+	{
+		return block * blockSize + static_cast<std::size_t>(superblocks[block * blockSize / superblockSize] + blocks[block]);
+	}
+
+	SourceFile rawFile;
+	const EscapeTable* table;
+	std::vector<std::uint64_t> superblocks;
+	std::vector<std::uint16_t> blocks;
+	std::size_t escapedTotal = 0;
+};
+
+// Unescapes a stream of escaped bytes into a fixed size, page aligned buffer, and writes it out whenever it's full.
+// An escape sequence may be split between two calls of write().
+class UnescapingWriter
+{
+public:
+	static constexpr std::size_t alignment = 4096;
+
+	UnescapingWriter(std::ostream& out, const EscapeTable& table, std::size_t bufferSize) :
+		out{ &out },
+		table{ &table },
+		capacity{ std::max(alignment, bufferSize / alignment * alignment) },
+		buffer{ static_cast<std::uint8_t*>(::operator new(capacity, std::align_val_t{ alignment })) }
+	{
+		out.exceptions(out.exceptions() | out.badbit | out.failbit);
+	}
+
+	void write(const std::uint8_t* data, std::size_t size)
+	{
+		const auto end = data + size;
+		if (pendingEscape && data < end)
+		{
+			put(table->decode(*data++));
+			pendingEscape = false;
+		}
+		while (data < end)
+		{
+			auto escape = std::find(data, end, table->escapeByte());
+			while (data < escape)
+			{
+				auto count = std::min(static_cast<std::size_t>(escape - data), capacity - filled);
+				std::memcpy(buffer.get() + filled, data, count);
+				filled += count;
+				data += count;
+				if (filled == capacity)
+				{
+					flush();
+				}
+			}
+			if (escape == end)
+			{
+				break;
+			}
+			if (escape + 1 == end)
+			{
+				pendingEscape = true;
+				break;
+			}
+			put(table->decode(escape[1]));
+			data = escape + 2;
+		}
+	}
+
+	// Bytes which don't need to be unescaped, i.e. raw bytes of the old file.
+	// Only valid between complete escape sequences; large runs bypass the buffer.
+	void writeRaw(const std::uint8_t* data, std::size_t size)
+	{
+		if (pendingEscape)
+		{
+			throw std::logic_error{ "Raw bytes can't follow an incomplete escape sequence" };
+		}
+		if (size >= capacity)
+		{
+			flush();
+			out->write(reinterpret_cast<const char*>(data), size);
+			writtenBytes += size;
+			countEvents(Counter::bytesWritten, size);
+			return;
+		}
+		while (size > 0)
+		{
+			auto count = std::min(size, capacity - filled);
+			std::memcpy(buffer.get() + filled, data, count);
+			filled += count;
+			data += count;
+			size -= count;
+			if (filled == capacity)
+			{
+				flush();
+			}
+		}
+	}
+
+	// Whether the last written byte is an escape byte waiting for its code
+	bool pending() const
+	{
+		return pendingEscape;
+	}
+
+	// Writes out everything which is still buffered
+	void finish()
+	{
+		if (pendingEscape)
+		{
+			throw std::runtime_error{ "Truncated escape sequence at the end of file, corrupted index file?" };
+		}
+		flush();
+		out->flush();
+	}
+
+	// Number of raw bytes written out so far
+	std::size_t written() const
+	{
+		return writtenBytes;
+	}
+
+private:
+	struct AlignedDelete
+	{
+		void operator()(std::uint8_t* pointer) const
+		{
+			::operator delete(pointer, std::align_val_t{ alignment });
+		}
+	};
+
+	void put(std::uint8_t byte)
+	{
+		buffer[filled++] = byte;
+		if (filled == capacity)
+		{
+			flush();
+		}
+	}
+
+	void flush()
+	{
+		out->write(reinterpret_cast<const char*>(buffer.get()), filled);
+		writtenBytes += filled;
+		countEvents(Counter::bytesWritten, filled);
+		filled = 0;
+	}
+
+	std::ostream* out;
+	const EscapeTable* table;
+	std::size_t capacity;
+	std::unique_ptr<std::uint8_t[], AlignedDelete> buffer;
+	std::size_t filled = 0;
+	std::size_t writtenBytes = 0;
+	bool pendingEscape = false;
+};
+
+// Follows the escape sequences of a stream of escaped bytes like UnescapingWriter,
+// but only counts the unescaped bytes instead of writing them
+class UnescapedSizeCounter
+{
+public:
+	explicit UnescapedSizeCounter(const EscapeTable& table) : table{ &table } {}
+
+	void write(const std::uint8_t* data, std::size_t size)
+	{
+		for (auto i = std::size_t{ 0 }; i < size; ++i)
+		{
+			if (pendingEscape)
+			{
+				pendingEscape = false;
+				++count;
+			}
+			else if (data[i] == table->escapeByte())
+			{
+				pendingEscape = true;
+			}
+			else
+			{
+				++count;
+			}
+		}
+	}
+
+	void writeRaw(const std::uint8_t*, std::size_t size)
+	{
+		count += size;
+	}
+
+	bool pending() const
+	{
+		return pendingEscape;
+	}
+
+	std::size_t size() const
+	{
+		return count;
+	}
+
+private:
+	const EscapeTable* table;
+	std::size_t count = 0;
+	bool pendingEscape = false;
+};
+
+// Writes [sourcePosition, sourcePosition + length) of the escaped form of a single old file, see writeChunkFromRaw
+template<typename Writer>
+void writeCopyFromRaw(Writer& writer, std::size_t sourcePosition, std::size_t length, const SourceFile& oldFile, const EscapeTable& table, const EscapeRankIndex& index)
+{
+	// Writes the escaped bytes [from, to) of the escaped form of the raw byte at raw
+	auto writeEscaped = [&writer, &table, &oldFile](std::size_t raw, std::size_t from, std::size_t to) {
+		auto byte = readByte(oldFile, raw);
+		auto sequence = std::array<std::uint8_t, 2>{ byte, 0 };
+		if (table.escapedSize(byte) == 2)
+		{
+			sequence = { table.escapeByte(), table.code(byte) };
+		}
+		writer.write(sequence.data() + from, to - from);
+	};
+
+	auto [begin, beginSkip] = index.locate(sourcePosition);
+	auto [end, endSkip] = index.locate(sourcePosition + length);
+	if (begin == end)
+	{
+		writeEscaped(begin, beginSkip, endSkip);
+		return;
+	}
+	if (beginSkip > 0)
+	{
+		writeEscaped(begin, beginSkip, table.escapedSize(readByte(oldFile, begin)));
+		++begin;
+	}
+	// The previous chunk ended in the middle of an escape sequence
+	while (writer.pending() && begin < end)
+	{
+		writeEscaped(begin, 0, table.escapedSize(readByte(oldFile, begin)));
+		++begin;
+	}
+	forEachPiece(oldFile, begin, end - begin, [&writer](const std::uint8_t* bytes, std::size_t count) {
+		writer.writeRaw(bytes, count);
+	});
+	if (endSkip > 0)
+	{
+		writeEscaped(end, 0, endSkip);
+	}
+}
+
+// The old files of an index file (the old file, followed by the reference files of multi-reference index files),
+// seen as the concatenation of their escaped forms, which is what copy chunks address
+class EscapedSources
+{
+public:
+	struct File
+	{
+		SourceFile raw;
+		EscapeRankIndex index;
+		// Offset of the escaped file in the concatenation
+		std::size_t escapedBegin;
+	};
+
+	EscapedSources(const std::vector<SourceFile>& files, const EscapeTable& table)
+	{
+		for (const auto& file : files)
+		{
+			auto index = EscapeRankIndex{ file, table };
+			auto escapedSize = index.escapedSize();
+			sources.push_back(File{ file, std::move(index), escapedTotal });
+			escapedTotal += escapedSize;
+		}
+	}
+
+	std::size_t escapedSize() const
+	{
+		return escapedTotal;
+	}
+
+	// Calls write(file, escapedOffset, length) for every part of [escapedOffset, escapedOffset + length) in a different file,
+	// with the offset relative to the escaped file
+	template<typename Write>
+	void forEachPart(std::size_t escapedOffset, std::size_t length, Write write) const
+	{
+		if (escapedOffset > escapedTotal || length > escapedTotal - escapedOffset)
+		{
+			throw std::out_of_range{ "chunk.sourcePosition + chunk.length > escapedOldFile.size(), corrupted index file / old file?" };
+		}
+		if (length == 0)
+		{
+			return;
+		}
+		auto file = std::upper_bound(sources.begin(), sources.end(), escapedOffset, [](std::size_t offset, const File& file) {
+			return offset < file.escapedBegin;
+		});
+		for (--file; length > 0; ++file)
+		{
+			auto localOffset = escapedOffset - file->escapedBegin;
+			auto count = std::min(length, file->index.escapedSize() - localOffset);
+			if (count > 0)
+			{
+				write(*file, localOffset, count);
+			}
+			escapedOffset += count;
+			length -= count;
+		}
+	}
+
+private:
+	std::vector<File> sources;
+	std::size_t escapedTotal = 0;
+};
+
+// Writes a chunk through writer.write (escaped bytes) and writer.writeRaw (raw bytes of the old files).
+// Copy chunks are located in the raw old files through their EscapeRankIndex and copied as is; only the escape sequences
+// split by the chunk edges, or following an incomplete escape sequence, are written in escaped form.
+template<typename Writer, typename Chunk>
+void writeChunkFromRaw(Writer& writer, const Chunk& chunk, const EscapeTable& table, const EscapedSources& sources)
+{
+	if (isLiteralChunk(chunk))
+	{
+		writer.write(literalData(chunk), chunk.length);
+		return;
+	}
+	sources.forEachPart(static_cast<std::size_t>(chunk.sourcePosition), static_cast<std::size_t>(chunk.length),
+		[&writer, &table](const EscapedSources::File& file, std::size_t sourcePosition, std::size_t length) {
+		writeCopyFromRaw(writer, sourcePosition, length, file.raw, table, file.index);
+	});
+}
+
+// Same as writeNewFileContentFromRaw, but the chunks are pulled one by one from nextChunk(), which returns nullptr
+// after the last one, so the chunk list never has to be entirely in memory.
+template<typename NextChunk, typename ShowProgress = decltype(voidNoOperation)>
+void writeNewFileContentFromChunkSource(std::ostream& out,
+	const std::vector<SourceFile>& oldFiles,
+	const EscapeData& escapeData,
+	NextChunk nextChunk,
+	std::size_t bufferSize,
+	ShowProgress showProgress = voidNoOperation)
+{
+	const auto table = EscapeTable{ escapeData };
+	const auto sources = EscapedSources{ oldFiles, table };
+	auto writer = UnescapingWriter{ out, table, bufferSize };
+
+	auto pendingProgress = std::size_t{ 0 };
+	while (const auto* chunk = nextChunk())
+	{
+		writeChunkFromRaw(writer, *chunk, table, sources);
+		pendingProgress += chunk->length;
+		if (pendingProgress > bufferSize)
+		{
+			showProgress(pendingProgress);
+			pendingProgress = 0;
+		}
+	}
+	writer.finish();
+	showProgress(pendingProgress);
+}
+
+// Same result as writeNewFileContent, but from the raw old file (for example memory mapped), see writeChunkFromRaw.
+// The output goes through a single fixed size buffer, so memory usage doesn't depend on the file sizes
+// (apart from the literal data of the index file itself).
+template<typename ShowProgress = decltype(voidNoOperation)>
+void writeNewFileContentFromRaw(std::ostream& out,
+	const std::uint8_t* oldFile,
+	std::size_t oldFileSize,
+	const WidePatchData& patchData,
+	std::size_t bufferSize,
+	ShowProgress showProgress = voidNoOperation)
+{
+	auto next = patchData.dataChunks.begin();
+	writeNewFileContentFromChunkSource(out, { SourceFile{ oldFile, oldFileSize } }, patchData.escapeData, [&]() {
+		return next == patchData.dataChunks.end() ? nullptr : &*next++;
+	}, bufferSize, showProgress);
+}
+
+// Sequential access to a chunk vector from any chunk, in the same way as ColumnarIndex::cursor
+class DataChunkList
+{
+public:
+	class Cursor
+	{
+	public:
+		Cursor(const std::vector<WideDataChunk>& chunks, std::size_t first) : chunks{ &chunks }, position{ first } {}
+
+		const WideDataChunk* next()
+		{
+			return position < chunks->size() ? &(*chunks)[position++] : nullptr;
+		}
+
+	private:
+		const std::vector<WideDataChunk>* chunks;
+		std::size_t position;
+	};
+
+	explicit DataChunkList(const std::vector<WideDataChunk>& chunks) : chunks{ &chunks } {}
+
+	std::size_t size() const
+	{
+		return chunks->size();
+	}
+
+	Cursor cursor(std::size_t first) const
+	{
+		return Cursor{ *chunks, first };
+	}
+
+private:
+	const std::vector<WideDataChunk>* chunks;
+};
+
+// Parallel version of writeNewFileContentFromRaw, writing directly into the output file.
+// A sequential pass over the chunks (which only scans the literal data) finds the unescaped offset of every chunk,
+// and the chunk list is cut into ranges of about the same (escaped) size, only at chunks which don't start
+// in the middle of an escape sequence. The ranges are then unescaped and written at their own offsets concurrently.
+// If checksums are given, every range is validated while it's written, and the blocks cut by range edges are read back at the end.
+// Chunks is either a DataChunkList or a ColumnarIndex.
+template<typename Chunks, typename ShowProgress = decltype(voidNoOperation)>
+void writeChunksFromRawInParallel(const std::filesystem::path& outputFileName,
+	const std::vector<SourceFile>& oldFiles,
+	const EscapeData& escapeData,
+	const Chunks& chunks,
+	std::size_t bufferSize,
+	WorkStealingPool& pool,
+	const ContentChecksums* checksums,
+	ShowProgress showProgress = voidNoOperation)
+{
+	constexpr auto rangesPerThread = std::size_t{ 4 };
+	const auto table = EscapeTable{ escapeData };
+	const auto sources = EscapedSources{ oldFiles, table };
+
+	auto escapedSize = std::size_t{ 0 };
+	for (auto cursor = chunks.cursor(0); const auto* chunk = cursor.next();)
+	{
+		escapedSize += chunk->length;
+	}
+
+	struct Range
+	{
+		std::size_t firstChunk;
+		std::size_t outputOffset;
+	};
+	auto ranges = std::vector<Range>{};
+	auto rangeSize = std::max<std::size_t>(1, escapedSize / (pool.size() * rangesPerThread));
+	auto counter = UnescapedSizeCounter{ table };
+	auto escapedOffset = std::size_t{ 0 };
+	auto cursor = chunks.cursor(0);
+	for (auto i = std::size_t{ 0 }; i < chunks.size(); ++i)
+	{
+		if (ranges.empty() || (counter.pending() == false && escapedOffset >= ranges.size() * rangeSize))
+		{
+			ranges.push_back(Range{ i, counter.size() });
+		}
+		const auto& chunk = *cursor.next();
+		writeChunkFromRaw(counter, chunk, table, sources);
+		escapedOffset += chunk.length;
+	}
+	if (counter.pending())
+	{
+		throw std::runtime_error{ "Truncated escape sequence at the end of file, corrupted index file?" };
+	}
+
+	if (checksums != nullptr && counter.size() != checksums->newFileSize)
+	{
+		throw std::runtime_error{ "New file size would be " + std::to_string(counter.size()) + " bytes instead of "
+			+ std::to_string(checksums->newFileSize) + ", corrupted index file?" };
+	}
+
+	auto output = OutputFile{ outputFileName, counter.size() };
+	auto mutex = std::mutex{};
+	auto uncheckedBlocks = std::vector<std::uint64_t>{};
+	auto workerBufferSize = std::max<std::size_t>(UnescapingWriter::alignment, bufferSize / pool.size());
+	pool.run(ranges.size(), [&](std::size_t rangeIndex, std::size_t) {
+		auto lastChunk = rangeIndex + 1 < ranges.size() ? ranges[rangeIndex + 1].firstChunk : chunks.size();
+		auto rangeBuffer = OutputFileRangeBuffer{ output, ranges[rangeIndex].outputOffset };
+		auto rangeStream = std::ostream{ &rangeBuffer };
+		auto validator = std::optional<NewFileValidator>{};
+		auto validatingBuffer = std::optional<ValidatingStreamBuffer>{};
+		if (checksums != nullptr)
+		{
+			validator.emplace(*checksums, ranges[rangeIndex].outputOffset);
+			validatingBuffer.emplace(rangeBuffer, *validator);
+			rangeStream.rdbuf(&*validatingBuffer);
+		}
+
+		auto writer = UnescapingWriter{ rangeStream, table, workerBufferSize };
+		auto written = std::size_t{ 0 };
+		auto rangeCursor = chunks.cursor(ranges[rangeIndex].firstChunk);
+		for (auto i = ranges[rangeIndex].firstChunk; i < lastChunk; ++i)
+		{
+			const auto& chunk = *rangeCursor.next();
+			writeChunkFromRaw(writer, chunk, table, sources);
+			written += chunk.length;
+		}
+		writer.finish();
+
+		auto lock = std::lock_guard{ mutex };
+		if (validator.has_value())
+		{
+			validator->finish();
+			uncheckedBlocks.insert(uncheckedBlocks.end(), validator->uncheckedBlocks().begin(), validator->uncheckedBlocks().end());
+		}
+		showProgress(written);
+	});
+
+	std::sort(uncheckedBlocks.begin(), uncheckedBlocks.end());
+	uncheckedBlocks.erase(std::unique(uncheckedBlocks.begin(), uncheckedBlocks.end()), uncheckedBlocks.end());
+	if (uncheckedBlocks.empty() == false)
+	{
+		auto input = std::ifstream{ outputFileName, std::ifstream::binary };
+		auto block = std::vector<char>{};
+		for (auto blockIndex : uncheckedBlocks)
+		{
+			auto begin = blockIndex * checksums->blockSize;
+			block.resize(static_cast<std::size_t>(std::min<std::uint64_t>(checksums->blockSize, checksums->newFileSize - begin)));
+			input.seekg(static_cast<std::streamoff>(begin));
+			input.read(block.data(), block.size());
+			auto hash = XXHash64{};
+			hash.update(block.data(), static_cast<std::size_t>(input.gcount()));
+			if (input.gcount() != static_cast<std::streamsize>(block.size()) || hash.digest() != checksums->blockHashes.at(blockIndex))
+			{
+				throw std::runtime_error{ "New file checksum mismatch in block #" + std::to_string(blockIndex) + ", corrupted index file / old file?" };
+			}
+		}
+	}
+}
+
+template<typename ShowProgress = decltype(voidNoOperation)>
+void writeNewFileContentFromRawInParallel(const std::filesystem::path& outputFileName,
+	const std::uint8_t* oldFile,
+	std::size_t oldFileSize,
+	const WidePatchData& patchData,
+	std::size_t bufferSize,
+	WorkStealingPool& pool,
+	const ContentChecksums* checksums,
+	ShowProgress showProgress = voidNoOperation)
+{
+	writeChunksFromRawInParallel(outputFileName, { SourceFile{ oldFile, oldFileSize } }, patchData.escapeData, DataChunkList{ patchData.dataChunks },
+		bufferSize, pool, checksums, showProgress);
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <sdsl/suffix_trees.hpp>
+#include "Instrumentation.hpp"
+
+// Matching statistics of a text (the escaped new file) against a CST: for every position of the text,
+// the length of the longest prefix of text[position..] occurring in the indexed string, and where it occurs.
+// They are computed from right to left with Weiner links (backward search on the CSA): extending a match by
+// one character costs one rank query, and a mismatch only climbs to the parent node, so the whole text is
+// processed in one linear pass without any sampled SA lookup or byte comparison.
+// Only the state at the beginning of every block is kept; a Cursor recomputes the statistics of a single block
+// from the next checkpoint when it's accessed, so memory stays proportional to the block size.
+template<typename Cst>
+class MatchingStatistics
+{
+public:
+	MatchingStatistics(const Cst& cst, const std::uint8_t* text, std::size_t size, std::size_t blockSize = defaultBlockSize) :
+		cst{ &cst },
+		text{ text },
+		size{ size },
+		blockSize{ blockSize }
+	{
+		auto blockCount = (size + blockSize - 1) / blockSize;
+		checkpoints.resize(blockCount, State{ cst.root(), 0 });
+		auto state = State{ cst.root(), 0 };
+		auto nodesVisited = std::uint64_t{ 0 };
+		for (auto i = size; i-- > 0;)
+		{
+			state = step(state, text[i], nodesVisited);
+			if (i % blockSize == 0)
+			{
+				checkpoints.at(i / blockSize) = state;
+			}
+		}
+		countEvents(Counter::cstNodesVisited, nodesVisited);
+	}
+
+	class Cursor
+	{
+	public:
+		explicit Cursor(const MatchingStatistics& statistics) : statistics{ &statistics } {}
+
+		// Same convention as bestMatch: [begin, end) of the longest match in the indexed string
+		std::pair<std::size_t, std::size_t> at(std::size_t position)
+		{
+			auto offset = load(position);
+			auto length = lengths.at(offset);
+			if (length == 0)
+			{
+				return { 0, 0 };
+			}
+			countEvents(Counter::csaLookups);
+			auto begin = static_cast<std::size_t>(statistics->cst->csa[lowerBounds.at(offset)]);
+			return { begin, begin + length };
+		}
+
+		// Only the length of the longest match, which doesn't need a suffix array lookup
+		std::size_t length(std::size_t position)
+		{
+			return lengths.at(load(position));
+		}
+
+	private:
+		// Computes the block of position if needed, and returns the offset of position in it
+		std::size_t load(std::size_t position)
+		{
+			auto block = position / statistics->blockSize;
+			if (block != currentBlock)
+			{
+				statistics->computeBlock(block, lengths, lowerBounds);
+				currentBlock = block;
+			}
+			return position - block * statistics->blockSize;
+		}
+
+		const MatchingStatistics* statistics;
+		std::size_t currentBlock = static_cast<std::size_t>(-1);
+		std::vector<std::size_t> lengths;
+		std::vector<std::size_t> lowerBounds;
+	};
+
+	static constexpr std::size_t defaultBlockSize = 64 * 1024;
+
+private:
+	using Node = typename Cst::node_type;
+
+	struct State
+	{
+		Node node; // The highest node whose path label starts with the current match
+		std::size_t length;
+	};
+
+	// Counts the nodes it goes through in nodesVisited
+	State step(State state, std::uint8_t character, std::uint64_t& nodesVisited) const
+	{
+		while (true)
+		{
+			++nodesVisited;
+			auto extended = cst->wl(state.node, character);
+			if (extended != cst->root())
+			{
+				return State{ extended, state.length + 1 };
+			}
+			if (state.node == cst->root())
+			{
+				return State{ cst->root(), 0 };
+			}
+			state.node = cst->parent(state.node);
+			state.length = cst->depth(state.node);
+		}
+	}
+
+	void computeBlock(std::size_t block, std::vector<std::size_t>& lengths, std::vector<std::size_t>& lowerBounds) const
+	{
+		auto begin = block * blockSize;
+		auto end = std::min(size, begin + blockSize);
+		auto state = block + 1 < checkpoints.size() ? checkpoints.at(block + 1) : State{ cst->root(), 0 };
+		lengths.resize(end - begin);
+		lowerBounds.resize(end - begin);
+		auto nodesVisited = std::uint64_t{ 0 };
+		for (auto i = end; i-- > begin;)
+		{
+			state = step(state, text[i], nodesVisited);
+			lengths.at(i - begin) = state.length;
+			lowerBounds.at(i - begin) = cst->lb(state.node);
+		}
+		countEvents(Counter::cstNodesVisited, nodesVisited);
+	}
+
+	const Cst* cst;
+	const std::uint8_t* text;
+	std::size_t size;
+	std::size_t blockSize;
+	std::vector<State> checkpoints;
+};
\ No newline at end of file
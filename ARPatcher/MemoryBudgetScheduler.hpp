@@ -0,0 +1,141 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Total physical memory of the machine, or 0 if it's unknown
+inline std::size_t physicalMemorySize()
+{
+#ifdef _WIN32
+	auto status = MEMORYSTATUSEX{};
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status) == FALSE)
+	{
+		return 0;
+	}
+	return static_cast<std::size_t>(status.ullTotalPhys);
+#else
+	auto pages = ::sysconf(_SC_PHYS_PAGES);
+	auto pageSize = ::sysconf(_SC_PAGESIZE);
+	if (pages <= 0 || pageSize <= 0)
+	{
+		return 0;
+	}
+	return static_cast<std::size_t>(pages) * static_cast<std::size_t>(pageSize);
+#endif
+}
+
+// Runs a batch of jobs on a fixed number of threads, but only starts a job when the estimated memory costs
+// of all running jobs (including the new one) fit in the memory budget.
+// Jobs are started in order, except that a later job which fits is started before an earlier one which doesn't.
+// A job which is larger than the whole budget is started alone, once nothing else is running.
+class MemoryBudgetScheduler
+{
+public:
+	MemoryBudgetScheduler(std::size_t threadCount, std::size_t memoryBudget) :
+		threadCount{ threadCount == 0 ? std::max<std::size_t>(1, std::thread::hardware_concurrency()) : threadCount },
+		memoryBudget{ memoryBudget }
+	{}
+
+	std::size_t size() const
+	{
+		return threadCount;
+	}
+
+	// Calls job(jobIndex) for every job, where costs[jobIndex] is its estimated memory usage in bytes, and waits for all of them.
+	// If any job throws, jobs which haven't started yet are abandoned and the first exception is rethrown.
+	template<typename Job>
+	void run(const std::vector<std::size_t>& costs, Job job)
+	{
+		auto mutex = std::mutex{};
+		auto changed = std::condition_variable{};
+		auto started = std::vector<bool>(costs.size(), false);
+		auto remaining = costs.size();
+		auto running = std::size_t{ 0 };
+		auto usedMemory = std::size_t{ 0 };
+		auto error = std::exception_ptr{};
+
+		auto work = [&]() {
+			auto lock = std::unique_lock{ mutex };
+			while (true)
+			{
+				auto next = costs.size();
+				changed.wait(lock, [&]() {
+					if (remaining == 0 || error)
+					{
+						return true;
+					}
+					for (auto i = std::size_t{ 0 }; i < costs.size(); ++i)
+					{
+						if (started[i] == false && (running == 0 || usedMemory + costs[i] <= memoryBudget))
+						{
+							next = i;
+							return true;
+						}
+					}
+					return false;
+				});
+				if (next == costs.size())
+				{
+					return;
+				}
+
+				started[next] = true;
+				--remaining;
+				++running;
+				usedMemory += costs[next];
+				lock.unlock();
+				try
+				{
+					job(next);
+				}
+				catch (...)
+				{
+					lock.lock();
+					if (error == nullptr)
+					{
+						error = std::current_exception();
+					}
+					lock.unlock();
+				}
+				lock.lock();
+				--running;
+				usedMemory -= costs[next];
+				changed.notify_all();
+			}
+		};
+
+		auto threads = std::vector<std::thread>{};
+		for (auto i = std::size_t{ 1 }; i < std::min(threadCount, costs.size()); ++i)
+		{
+			threads.emplace_back(work);
+		}
+		work();
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+private:
+	std::size_t threadCount;
+	std::size_t memoryBudget;
+};
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARPATCHER_SSE2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit of a non zero mask
+inline unsigned countTrailingZeros(std::uint32_t mask)
+{
+#ifdef _MSC_VER
+	auto index = unsigned long{ 0 };
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned>(index);
+#else
+	return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Length of the common prefix of two byte ranges of at least maxLength bytes.
+// Compares 32 bytes at a time with AVX2 and 16 bytes at a time with SSE2, depending on the target architecture
+// (/arch:AVX2 or -mavx2 enables the former), and 8 bytes at a time otherwise.
+inline std::size_t mismatchLength(const std::uint8_t* left, const std::uint8_t* right, std::size_t maxLength)
+{
+	auto i = std::size_t{ 0 };
+#ifdef __AVX2__
+	for (; i + 32 <= maxLength; i += 32)
+	{
+		const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+		const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+		const auto equal = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+		if (equal != 0xFFFFFFFF)
+		{
+			return i + countTrailingZeros(~equal);
+		}
+	}
+#endif
+#ifdef ARPATCHER_SSE2
+	for (; i + 16 <= maxLength; i += 16)
+	{
+		const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+		const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+		const auto equal = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+		if (equal != 0xFFFF)
+		{
+			return i + countTrailingZeros(~equal);
+		}
+	}
+#else
+	for (; i + 8 <= maxLength; i += 8)
+	{
+		auto a = std::uint64_t{};
+		auto b = std::uint64_t{};
+		std::memcpy(&a, left + i, sizeof(a));
+		std::memcpy(&b, right + i, sizeof(b));
+		if (a != b)
+		{
+			break;
+		}
+	}
+#endif
+	while (i < maxLength && left[i] == right[i])
+	{
+		++i;
+	}
+	return i;
+}
\ No newline at end of file
@@ -0,0 +1,253 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <vector>
+#include "WidePatchData.hpp"
+#include "EntropyCoding.hpp"
+
+// Encoded size of chunk headers in an index file (before entropy coding), which findChunksOptimal minimizes
+struct ChunkCostModel
+{
+	// Compact (and, approximately, columnar) index files: varint length, and a varint source delta which is
+	// assumed to take two bytes (it's a single byte when a copy continues where the previous one stopped)
+	static ChunkCostModel compact()
+	{
+		return ChunkCostModel{ false };
+	}
+
+	// Uncompressed index files: 32 bit length and 32 bit source position
+	static ChunkCostModel fixed()
+	{
+		return ChunkCostModel{ true };
+	}
+
+	std::size_t copyCost(std::uint64_t length) const
+	{
+		return fixedHeaders ? 8 : varintSize(length) + 2;
+	}
+
+	// Paid once for every run of literal bytes, whose varint length is assumed to take one byte
+	std::size_t literalHeaderCost() const
+	{
+		return fixedHeaders ? 8 : 2;
+	}
+
+	bool fixedHeaders;
+};
+
+// Optimal parse of the new file: instead of always taking the longest match at the current position,
+// finds the chunk list of minimum encoded size with a shortest path over the positions of the new file.
+// Every section offers its longest match at every position, and any prefix of it (at least minimumChunkSize long).
+// By the property of matching statistics, position + longest match length never decreases, so for every position
+// the copies which can end there start in a sliding window of positions, and the cheapest one is kept in a monotone queue
+// (one per section and per varint length size), which makes the whole parse linear.
+// The new file is parsed in windows of windowSize bytes, which bounds memory usage; a match crossing a window edge is split.
+// Matches provides sectionCount(), matchLength(section, iterator) and matchSource(section, iterator)
+// (the position of the match in the escaped old file).
+template<typename RandomAccessIterator, typename Matches, typename ShowProgress>
+std::vector<WideDataChunk> findChunksOptimal(RandomAccessIterator newFileBegin,
+	RandomAccessIterator newFileEnd,
+	std::size_t minimumChunkSize,
+	Matches& matches,
+	const ChunkCostModel& costModel,
+	ShowProgress showProgress)
+{
+	constexpr auto windowSize = std::size_t{ 256 * 1024 };
+	constexpr auto infinity = std::numeric_limits<std::uint64_t>::max() / 4;
+	// Copy lengths below these limits have one, two and three bytes varint lengths (windowSize is below the last one)
+	constexpr auto lengthLimits = std::array<std::size_t, 3>{ 1 << 7, 1 << 14, 1 << 21 };
+	static_assert(windowSize < lengthLimits.back());
+
+	// Best ways to reach a position of the window, ending with a literal byte or with a copy
+	struct Position
+	{
+		std::uint64_t literalCost;
+		std::uint64_t copyCost;
+		std::uint32_t copyBegin;
+		std::uint32_t copySection;
+		bool literalAfterCopy;
+
+		std::uint64_t cost() const
+		{
+			return std::min(literalCost, copyCost);
+		}
+	};
+
+	// Positions in increasing order of cost(), from which a copy can start
+	class MonotoneQueue
+	{
+	public:
+		void clear(std::size_t capacity)
+		{
+			items.resize(capacity);
+			head = 0;
+			tail = 0;
+		}
+
+		void push(std::uint32_t position, const std::vector<Position>& positions)
+		{
+			const auto cost = positions[position].cost();
+			while (tail > head && positions[items[tail - 1]].cost() >= cost)
+			{
+				--tail;
+			}
+			items[tail++] = position;
+		}
+
+		void popBefore(std::size_t position)
+		{
+			while (head < tail && items[head] < position)
+			{
+				++head;
+			}
+		}
+
+		bool empty() const
+		{
+			return head == tail;
+		}
+
+		std::uint32_t front() const
+		{
+			return items[head];
+		}
+
+	private:
+		std::vector<std::uint32_t> items;
+		std::size_t head = 0;
+		std::size_t tail = 0;
+	};
+
+	const auto sectionCount = matches.sectionCount();
+	const auto minimumCopyLength = std::max<std::size_t>(minimumChunkSize, 1);
+	auto classCosts = std::array<std::uint64_t, lengthLimits.size()>{};
+	auto classMinimumLengths = std::array<std::size_t, lengthLimits.size()>{};
+	for (auto k = std::size_t{ 0 }; k < lengthLimits.size(); ++k)
+	{
+		classMinimumLengths[k] = std::max(minimumCopyLength, k == 0 ? std::size_t{ 1 } : lengthLimits[k - 1]);
+		classCosts[k] = costModel.copyCost(classMinimumLengths[k]);
+	}
+
+	auto chunks = std::vector<WideDataChunk>{};
+	auto positions = std::vector<Position>(windowSize + 1);
+	// For every section, the (capped) end of the longest match starting at every position of the window
+	auto matchEnds = std::vector<std::vector<std::uint32_t>>(sectionCount, std::vector<std::uint32_t>(windowSize));
+	auto queues = std::vector<MonotoneQueue>(sectionCount * lengthLimits.size());
+	auto firstStarts = std::vector<std::size_t>(sectionCount);
+	for (auto windowBegin = newFileBegin; windowBegin < newFileEnd;)
+	{
+		const auto size = static_cast<std::size_t>(std::min<std::ptrdiff_t>(windowSize, newFileEnd - windowBegin));
+		for (auto s = std::size_t{ 0 }; s < sectionCount; ++s)
+		{
+			auto& ends = matchEnds[s];
+			for (auto i = std::size_t{ 0 }; i < size; ++i)
+			{
+				ends[i] = static_cast<std::uint32_t>(i + std::min(matches.matchLength(s, windowBegin + i), size - i));
+			}
+			// Makes sure the ends never decrease, only by shortening matches
+			for (auto i = size - 1; i-- > 0;)
+			{
+				ends[i] = std::min(ends[i], ends[i + 1]);
+			}
+		}
+		for (auto& queue : queues)
+		{
+			queue.clear(size);
+		}
+		std::fill(firstStarts.begin(), firstStarts.end(), std::size_t{ 0 });
+
+		// Continuing a literal chunk of the previous window doesn't cost another header
+		const auto previousIsLiteral = chunks.empty() == false && isLiteralChunk(chunks.back());
+		positions[0] = Position{ previousIsLiteral ? 0 : infinity, previousIsLiteral ? infinity : 0, 0, 0, false };
+		for (auto j = std::size_t{ 1 }; j <= size; ++j)
+		{
+			auto& position = positions[j];
+			const auto& previous = positions[j - 1];
+			const auto fromLiteral = previous.literalCost + 1;
+			const auto fromCopy = previous.copyCost + 1 + costModel.literalHeaderCost();
+			position.literalCost = std::min(fromLiteral, fromCopy);
+			position.literalAfterCopy = fromCopy < fromLiteral;
+
+			position.copyCost = infinity;
+			for (auto s = std::size_t{ 0 }; s < sectionCount; ++s)
+			{
+				auto& firstStart = firstStarts[s];
+				while (firstStart < j && matchEnds[s][firstStart] < j)
+				{
+					++firstStart;
+				}
+				for (auto k = std::size_t{ 0 }; k < lengthLimits.size(); ++k)
+				{
+					auto& queue = queues[s * lengthLimits.size() + k];
+					if (j >= classMinimumLengths[k])
+					{
+						queue.push(static_cast<std::uint32_t>(j - classMinimumLengths[k]), positions);
+					}
+					queue.popBefore(std::max(firstStart, j >= lengthLimits[k] ? j - lengthLimits[k] + 1 : 0));
+					if (queue.empty() == false && positions[queue.front()].cost() + classCosts[k] < position.copyCost)
+					{
+						position.copyCost = positions[queue.front()].cost() + classCosts[k];
+						position.copyBegin = queue.front();
+						position.copySection = static_cast<std::uint32_t>(s);
+					}
+				}
+			}
+		}
+
+		// Walks the shortest path backwards, and then appends its chunks
+		struct Step
+		{
+			std::size_t begin;
+			std::size_t end;
+			std::optional<std::uint32_t> section;
+		};
+		auto steps = std::vector<Step>{};
+		auto inLiteral = positions[size].literalCost <= positions[size].copyCost;
+		for (auto j = size; j > 0;)
+		{
+			if (inLiteral)
+			{
+				if (steps.empty() || steps.back().section.has_value() || steps.back().begin != j)
+				{
+					steps.push_back(Step{ j, j, std::nullopt });
+				}
+				steps.back().begin = j - 1;
+				inLiteral = positions[j].literalAfterCopy == false;
+				j -= 1;
+			}
+			else
+			{
+				const auto& position = positions[j];
+				steps.push_back(Step{ position.copyBegin, j, position.copySection });
+				j = position.copyBegin;
+				inLiteral = positions[j].literalCost <= positions[j].copyCost;
+			}
+		}
+		for (auto step = steps.rbegin(); step != steps.rend(); ++step)
+		{
+			const auto length = step->end - step->begin;
+			if (step->section.has_value())
+			{
+				chunks.emplace_back(length, matches.matchSource(*step->section, windowBegin + step->begin), std::vector<std::uint8_t>{});
+			}
+			else if (chunks.empty() == false && isLiteralChunk(chunks.back()))
+			{
+				auto& previous = chunks.back();
+				previous.data.insert(previous.data.end(), windowBegin + step->begin, windowBegin + step->end);
+				previous.length += length;
+			}
+			else
+			{
+				chunks.emplace_back(length, static_cast<std::uint64_t>(-1), std::vector<std::uint8_t>(windowBegin + step->begin, windowBegin + step->end));
+			}
+		}
+
+		windowBegin += size;
+		showProgress(size);
+	}
+	return chunks;
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <filesystem>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// A file of a known size, created up front, which can be written at arbitrary offsets by several threads at once
+class OutputFile
+{
+public:
+	OutputFile(const std::filesystem::path& path, std::uint64_t size)
+	{
+#ifdef _WIN32
+		file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error{ "Failed to create " + path.string() };
+		}
+		auto end = LARGE_INTEGER{};
+		end.QuadPart = static_cast<LONGLONG>(size);
+		if (SetFilePointerEx(file, end, nullptr, FILE_BEGIN) == FALSE || SetEndOfFile(file) == FALSE)
+		{
+			CloseHandle(file);
+			throw std::runtime_error{ "Failed to resize " + path.string() };
+		}
+#else
+		file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (file == -1)
+		{
+			throw std::runtime_error{ "Failed to create " + path.string() };
+		}
+		if (::ftruncate(file, static_cast<off_t>(size)) != 0)
+		{
+			::close(file);
+			throw std::runtime_error{ "Failed to resize " + path.string() };
+		}
+#endif
+	}
+
+	OutputFile(const OutputFile&) = delete;
+	OutputFile& operator=(const OutputFile&) = delete;
+
+	~OutputFile()
+	{
+#ifdef _WIN32
+		CloseHandle(file);
+#else
+		::close(file);
+#endif
+	}
+
+	void writeAt(std::uint64_t offset, const void* data, std::size_t size)
+	{
+		auto bytes = static_cast<const char*>(data);
+		while (size > 0)
+		{
+#ifdef _WIN32
+			auto overlapped = OVERLAPPED{};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			auto written = DWORD{ 0 };
+			auto count = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+			if (WriteFile(file, bytes, count, &written, &overlapped) == FALSE || written == 0)
+			{
+				throw std::runtime_error{ "Failed to write output file" };
+			}
+#else
+			auto written = ::pwrite(file, bytes, size, static_cast<off_t>(offset));
+			if (written <= 0)
+			{
+				throw std::runtime_error{ "Failed to write output file" };
+			}
+#endif
+			bytes += written;
+			offset += static_cast<std::uint64_t>(written);
+			size -= static_cast<std::size_t>(written);
+		}
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+#else
+	int file = -1;
+#endif
+};
+
+// Unbuffered stream buffer writing sequentially into an OutputFile from a starting offset,
+// so a range of the file can be filled through a std::ostream
+class OutputFileRangeBuffer : public std::streambuf
+{
+public:
+	OutputFileRangeBuffer(OutputFile& file, std::uint64_t offset) : file{ &file }, offset{ offset } {}
+
+protected:
+	std::streamsize xsputn(const char* data, std::streamsize size) override
+	{
+		file->writeAt(offset, data, static_cast<std::size_t>(size));
+		offset += static_cast<std::uint64_t>(size);
+		return size;
+	}
+
+	int_type overflow(int_type character) override
+	{
+		if (traits_type::eq_int_type(character, traits_type::eof()) == false)
+		{
+			auto value = traits_type::to_char_type(character);
+			xsputn(&value, 1);
+		}
+		return traits_type::not_eof(character);
+	}
+
+private:
+	OutputFile* file;
+	std::uint64_t offset;
+};
\ No newline at end of file
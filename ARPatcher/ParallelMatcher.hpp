@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "WidePatchData.hpp"
+#include "WorkStealingPool.hpp"
+
+// Begin positions (relative to the beginning of the file) of segments no longer than segmentSize.
+// Every one of the fixed segments ([begin, end) pairs, sorted and non overlapping) is kept as a single segment.
+inline std::vector<std::size_t> makeSegmentBoundaries(std::size_t totalSize,
+	std::size_t segmentSize,
+	const std::vector<std::pair<std::size_t, std::size_t>>& fixedSegments = {})
+{
+	segmentSize = std::max<std::size_t>(segmentSize, 1);
+	auto boundaries = std::vector<std::size_t>{};
+	auto position = std::size_t{ 0 };
+	auto splitUntil = [&boundaries, &position, segmentSize](std::size_t end) {
+		for (; position < end; position += std::min(segmentSize, end - position))
+		{
+			boundaries.push_back(position);
+		}
+	};
+	for (const auto& [fixedBegin, fixedEnd] : fixedSegments)
+	{
+		splitUntil(fixedBegin);
+		if (fixedBegin < fixedEnd)
+		{
+			boundaries.push_back(fixedBegin);
+			position = fixedEnd;
+		}
+	}
+	splitUntil(totalSize);
+	return boundaries;
+}
+
+// Splits the escaped new file into independent segments starting at segmentBoundaries, runs findChunks(segmentBegin, segmentEnd)
+// on them through the work stealing pool, and then stitches the results together.
+// Matches found inside a segment stop at the segment end, so at every boundary the last copy chunk is matched again
+// with findMatch(chunkBegin, end) (which is allowed to cross the boundary), and the chunks it covers are dropped or trimmed.
+template<typename RandomAccessIterator, typename FindChunks, typename FindMatch>
+std::vector<WideDataChunk> findChunksInParallel(WorkStealingPool& pool,
+	RandomAccessIterator begin,
+	RandomAccessIterator end,
+	const std::vector<std::size_t>& segmentBoundaries,
+	std::size_t minimumChunkSize,
+	FindChunks findChunks,
+	FindMatch findMatch)
+{
+	constexpr auto literalPosition = static_cast<std::uint64_t>(-1);
+	const auto totalSize = static_cast<std::size_t>(end - begin);
+	const auto segmentCount = segmentBoundaries.size();
+	auto segmentEnd = [&](std::size_t segmentIndex) {
+		return segmentIndex + 1 < segmentCount ? segmentBoundaries.at(segmentIndex + 1) : totalSize;
+	};
+
+	auto segments = std::vector<std::vector<WideDataChunk>>(segmentCount);
+	pool.run(segmentCount, [&](std::size_t segmentIndex, std::size_t) {
+		segments.at(segmentIndex) = findChunks(begin + segmentBoundaries.at(segmentIndex), begin + segmentEnd(segmentIndex));
+	});
+
+	auto result = std::vector<WideDataChunk>{};
+	auto position = std::size_t{ 0 }; // end of the last chunk in result, relative to begin
+	auto append = [&result, &position](WideDataChunk&& chunk) {
+		position += chunk.length;
+		if (result.empty() == false && result.back().sourcePosition == literalPosition && chunk.sourcePosition == literalPosition)
+		{
+			auto& previous = result.back();
+			previous.data.insert(previous.data.end(), chunk.data.begin(), chunk.data.end());
+			previous.length += chunk.length;
+			return;
+		}
+		result.push_back(std::move(chunk));
+	};
+
+	for (auto segmentIndex = std::size_t{ 0 }; segmentIndex < segmentCount; ++segmentIndex)
+	{
+		const auto segmentBegin = segmentBoundaries.at(segmentIndex);
+
+		// Try to extend the chunk ending at this boundary into the current segment
+		if (position == segmentBegin && result.empty() == false && result.back().sourcePosition != literalPosition)
+		{
+			auto& last = result.back();
+			auto lastBegin = position - last.length;
+			auto [matchBegin, matchEnd] = findMatch(begin + lastBegin, end);
+			if (matchEnd - matchBegin > last.length)
+			{
+				last.sourcePosition = matchBegin;
+				last.length = matchEnd - matchBegin;
+				position = lastBegin + last.length;
+			}
+		}
+
+		// Drop or trim chunks which are already covered by the previous ones
+		auto chunkBegin = segmentBegin;
+		for (auto& chunk : segments.at(segmentIndex))
+		{
+			const auto chunkEnd = chunkBegin + chunk.length;
+			if (chunkEnd > position)
+			{
+				if (chunkBegin < position)
+				{
+					const auto covered = position - chunkBegin;
+					chunk.length -= covered;
+					if (chunk.sourcePosition == literalPosition)
+					{
+						chunk.data.erase(chunk.data.begin(), chunk.data.begin() + covered);
+					}
+					else if (chunk.length < minimumChunkSize)
+					{
+						chunk.sourcePosition = literalPosition;
+						chunk.data.assign(begin + position, begin + chunkEnd);
+					}
+					else
+					{
+						chunk.sourcePosition += covered;
+					}
+				}
+				append(std::move(chunk));
+			}
+			chunkBegin = chunkEnd;
+		}
+		segments.at(segmentIndex).clear();
+		segments.at(segmentIndex).shrink_to_fit();
+	}
+	return result;
+}
\ No newline at end of file
@@ -8,10 +8,10 @@
 #include <string_view>
 #include <istream>
 #include <ostream>
-#include <PatchData.hpp>
 #include <Escape.hpp>
+#include "WidePatchData.hpp"
 
-std::vector<std::uint8_t> getNewFileContent(const std::vector<std::uint8_t>& escapedOldFile, const PatchData& patchData)
+inline std::vector<std::uint8_t> getNewFileContent(const std::vector<std::uint8_t>& escapedOldFile, const WidePatchData& patchData)
 {
 	auto newFileData = std::vector<std::uint8_t>{};
 
@@ -19,13 +19,13 @@ std::vector<std::uint8_t> getNewFileContent(const std::vector<std::uint8_t>& esc
 	{
 		auto copyBegin = newFileData.size();
 		newFileData.resize(copyBegin + chunk.length);
-		if (chunk.sourcePosition == static_cast<std::uint32_t>(-1))
+		if (isLiteralChunk(chunk))
 		{
 			std::copy_n(chunk.data.begin(), chunk.length, newFileData.begin() + copyBegin);
 		}
 		else
 		{
-			if (chunk.sourcePosition + chunk.length > escapedOldFile.size())
+			if (chunk.sourcePosition > escapedOldFile.size() || chunk.length > escapedOldFile.size() - chunk.sourcePosition)
 			{
 				throw std::out_of_range{ "chunk.sourcePosition + chunk.length > escapedOldFile.size(), corrupted index file / old file?" };
 			}
@@ -36,11 +36,11 @@ std::vector<std::uint8_t> getNewFileContent(const std::vector<std::uint8_t>& esc
 	return unescape(newFileData, patchData.escapeData);
 }
 
-auto voidNoOperation = [](...) {};
+inline auto voidNoOperation = [](...) {};
 template<typename ShowProgress = decltype(voidNoOperation)>
 void writeNewFileContent(std::ostream& out, 
 	const std::vector<std::uint8_t>& escapedOldFile, 
-	const PatchData& patchData, 
+	const WidePatchData& patchData, 
 	std::size_t maxBufferSize,
 	ShowProgress showProgress = voidNoOperation)
 {
@@ -50,13 +50,13 @@ void writeNewFileContent(std::ostream& out,
 	{
 		auto copyBegin = newFileData.size();
 		newFileData.resize(copyBegin + chunk.length);
-		if (chunk.sourcePosition == static_cast<std::uint32_t>(-1))
+		if (isLiteralChunk(chunk))
 		{
 			std::copy_n(chunk.data.begin(), chunk.length, newFileData.begin() + copyBegin);
 		}
 		else
 		{
-			if (chunk.sourcePosition + chunk.length > escapedOldFile.size())
+			if (chunk.sourcePosition > escapedOldFile.size() || chunk.length > escapedOldFile.size() - chunk.sourcePosition)
 			{
 				throw std::out_of_range{ "chunk.sourcePosition + chunk.length > escapedOldFile.size(), corrupted index file / old file?" };
 			}
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "WidePatchData.hpp"
+#include "Checksums.hpp"
+
+// Composes the index files of an old file -> intermediate file and of an intermediate file -> new file
+// into an old file -> new file index file, only by mapping and splitting the chunks, so the intermediate file is never built.
+// Every chunk of the second index file copies from the escaped intermediate file, which is the concatenation
+// of the chunks of the first one: the copied range is located among them with a binary search, and replaced by the
+// corresponding parts of these chunks. Runs in time proportional to the chunk counts (and the size of the literal chunks).
+// Both index files must use the same escape byte, otherwise the escaped intermediate files they refer to are different:
+// ARPatcher -generateIndexFile -escapeFrom <first index file> generates the second one with the escape byte of the first one.
+class PatchComposer
+{
+public:
+	explicit PatchComposer(const WidePatchData& first) : first{ &first }
+	{
+		chunkEnds.reserve(first.dataChunks.size());
+		auto end = std::uint64_t{ 0 };
+		for (const auto& chunk : first.dataChunks)
+		{
+			end += chunk.length;
+			chunkEnds.push_back(end);
+		}
+	}
+
+	WidePatchData compose(const WidePatchData& second) const
+	{
+		if (second.escapeData.escape != first->escapeData.escape)
+		{
+			throw std::invalid_argument{ "Index files use different escape bytes (" + std::to_string(first->escapeData.escape) + " and "
+				+ std::to_string(second.escapeData.escape) + "), they can only be applied one after another;"
+				+ " generate the next index files with -escapeFrom <first index file> to compose them" };
+		}
+		if (second.referenceFileNames.empty() == false)
+		{
+			throw std::invalid_argument{ "Only the first index file of a chain can have reference files" };
+		}
+
+		auto result = WidePatchData{ first->oldFileName, second.newFileName, first->escapeData, {}, first->referenceFileNames };
+		for (const auto& chunk : second.dataChunks)
+		{
+			if (isLiteralChunk(chunk))
+			{
+				appendLiteral(result.dataChunks, chunk.data.begin(), chunk.data.begin() + static_cast<std::ptrdiff_t>(chunk.length));
+				continue;
+			}
+			if (chunk.sourcePosition > escapedIntermediateSize() || chunk.length > escapedIntermediateSize() - chunk.sourcePosition)
+			{
+				throw std::out_of_range{ "chunk.sourcePosition + chunk.length > escaped intermediate file size, the index files don't form a chain?" };
+			}
+			auto position = chunk.sourcePosition;
+			const auto end = chunk.sourcePosition + chunk.length;
+			auto index = static_cast<std::size_t>(std::upper_bound(chunkEnds.begin(), chunkEnds.end(), position) - chunkEnds.begin());
+			for (; position < end; ++index)
+			{
+				const auto& source = first->dataChunks[index];
+				const auto sourceBegin = chunkEnds[index] - source.length;
+				const auto offset = position - sourceBegin;
+				const auto length = std::min(end, chunkEnds[index]) - position;
+				if (isLiteralChunk(source))
+				{
+					const auto data = source.data.begin() + static_cast<std::ptrdiff_t>(offset);
+					appendLiteral(result.dataChunks, data, data + static_cast<std::ptrdiff_t>(length));
+				}
+				else
+				{
+					appendCopy(result.dataChunks, source.sourcePosition + offset, length);
+				}
+				position += length;
+			}
+		}
+		return result;
+	}
+
+	std::uint64_t escapedIntermediateSize() const
+	{
+		return chunkEnds.empty() ? 0 : chunkEnds.back();
+	}
+
+private:
+	// Copies continuing the previous one and consecutive literals are merged, which undoes most of the splitting
+	static void appendCopy(std::vector<WideDataChunk>& chunks, std::uint64_t sourcePosition, std::uint64_t length)
+	{
+		if (length == 0)
+		{
+			return;
+		}
+		if (chunks.empty() == false && isLiteralChunk(chunks.back()) == false
+			&& chunks.back().sourcePosition + chunks.back().length == sourcePosition)
+		{
+			chunks.back().length += length;
+			return;
+		}
+		chunks.emplace_back(length, sourcePosition, std::vector<std::uint8_t>{});
+	}
+
+	template<typename Iterator>
+	static void appendLiteral(std::vector<WideDataChunk>& chunks, Iterator begin, Iterator end)
+	{
+		if (begin == end)
+		{
+			return;
+		}
+		if (chunks.empty() || isLiteralChunk(chunks.back()) == false)
+		{
+			chunks.emplace_back(0, static_cast<std::uint64_t>(-1), std::vector<std::uint8_t>{});
+		}
+		auto& chunk = chunks.back();
+		chunk.data.insert(chunk.data.end(), begin, end);
+		chunk.length = chunk.data.size();
+	}
+
+	const WidePatchData* first;
+	// End of every chunk of the first index file in the escaped intermediate file
+	std::vector<std::uint64_t> chunkEnds;
+};
+
+// Checksums of the composed index file: the old files of the first index file and the new file of the second one.
+// Throws if both index files have checksums and the new file of the first one isn't the old file of the second one.
+inline std::optional<ContentChecksums> composeChecksums(const std::optional<ContentChecksums>& first, const std::optional<ContentChecksums>& second)
+{
+	if (first.has_value() == false || second.has_value() == false)
+	{
+		return std::nullopt;
+	}
+	if (first->newFileSize != second->oldFileSize || first->newFileHash != second->oldFileHash)
+	{
+		throw std::invalid_argument{ "The new file of an index file isn't the old file of the next one, the index files don't form a chain" };
+	}
+	auto result = *second;
+	result.oldFileSize = first->oldFileSize;
+	result.oldFileHash = first->oldFileHash;
+	result.referenceFiles = first->referenceFiles;
+	return result;
+}
\ No newline at end of file
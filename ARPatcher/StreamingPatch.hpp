@@ -0,0 +1,362 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "Utilities.hpp"
+#include "MappedFile.hpp"
+#include "MappedPatch.hpp"
+#include "IndexFile.hpp"
+#include "Checksums.hpp"
+
+// Library interface to apply index files in process, for example from a launcher, with constant memory usage:
+// the chunks are pulled lazily from an IndexFileReader (on a file, any std::istream, or a buffer in memory),
+// the old files are read through PatchSource and the new file is written to a PatchSink.
+
+// Raw content of an old file (or of a reference file), which the applier reads at random offsets.
+// Sources which aren't in memory as a whole (an entry of an archive, a decrypted file...) only implement size() and read(),
+// and are read through buffers of a bounded size; data() lets memory mapped sources be used without copying.
+class PatchSource
+{
+public:
+	virtual ~PatchSource() = default;
+	virtual std::uint64_t size() const = 0;
+	// Copies the size bytes at offset to out
+	virtual void read(std::uint64_t offset, std::uint8_t* out, std::size_t size) const = 0;
+	// The whole content, if it's in memory; read() isn't called when it isn't nullptr
+	virtual const std::uint8_t* data() const
+	{
+		return nullptr;
+	}
+};
+
+class MappedFileSource : public PatchSource
+{
+public:
+	explicit MappedFileSource(const std::filesystem::path& fileName) : file{ fileName } {}
+
+	const std::uint8_t* data() const override
+	{
+		return file.data();
+	}
+
+	std::uint64_t size() const override
+	{
+		return file.size();
+	}
+
+	void read(std::uint64_t offset, std::uint8_t* out, std::size_t size) const override
+	{
+		std::copy_n(file.data() + offset, size, out);
+	}
+
+private:
+	MappedFile file;
+};
+
+// Doesn't own the bytes, which must outlive it
+class MemoryViewSource : public PatchSource
+{
+public:
+	MemoryViewSource(const std::uint8_t* bytes, std::size_t byteCount) : bytes{ bytes }, byteCount{ byteCount } {}
+
+	const std::uint8_t* data() const override
+	{
+		return bytes;
+	}
+
+	std::uint64_t size() const override
+	{
+		return byteCount;
+	}
+
+	void read(std::uint64_t offset, std::uint8_t* out, std::size_t size) const override
+	{
+		std::copy_n(bytes + offset, size, out);
+	}
+
+private:
+	const std::uint8_t* bytes;
+	std::size_t byteCount;
+};
+
+class MemorySource : public PatchSource
+{
+public:
+	explicit MemorySource(std::vector<std::uint8_t> contents) : contents{ std::move(contents) } {}
+
+	const std::uint8_t* data() const override
+	{
+		return contents.data();
+	}
+
+	std::uint64_t size() const override
+	{
+		return contents.size();
+	}
+
+	void read(std::uint64_t offset, std::uint8_t* out, std::size_t size) const override
+	{
+		std::copy_n(contents.data() + offset, size, out);
+	}
+
+private:
+	std::vector<std::uint8_t> contents;
+};
+
+// byteCount bytes of a seekable std::istream starting at begin, for example an entry of an archive, read without loading them.
+// The stream must outlive the source, and isn't used by anything else while the patch is applied.
+class StreamSource : public PatchSource
+{
+public:
+	StreamSource(std::istream& in, std::uint64_t begin, std::uint64_t byteCount) : in{ &in }, begin{ begin }, byteCount{ byteCount } {}
+
+	std::uint64_t size() const override
+	{
+		return byteCount;
+	}
+
+	void read(std::uint64_t offset, std::uint8_t* out, std::size_t size) const override
+	{
+		if (offset + size > byteCount)
+		{
+			throw std::out_of_range{ "Read past the end of the old file" };
+		}
+		in->clear();
+		in->seekg(static_cast<std::streamoff>(begin + offset));
+		if (in->read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(size)).gcount() != static_cast<std::streamsize>(size))
+		{
+			throw std::runtime_error{ "Failed to read the old file" };
+		}
+	}
+
+private:
+	std::istream* in;
+	std::uint64_t begin;
+	std::uint64_t byteCount;
+};
+
+// Receives the new file, in order
+class PatchSink
+{
+public:
+	virtual ~PatchSink() = default;
+	virtual void write(const std::uint8_t* data, std::size_t size) = 0;
+	// Called once after the whole new file has been written and validated
+	virtual void finish() {}
+};
+
+class StreamSink : public PatchSink
+{
+public:
+	explicit StreamSink(std::ostream& out) : out{ &out }
+	{
+		out.exceptions(out.exceptions() | out.badbit | out.failbit);
+	}
+
+	void write(const std::uint8_t* data, std::size_t size) override
+	{
+		out->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+	}
+
+	void finish() override
+	{
+		out->flush();
+	}
+
+private:
+	std::ostream* out;
+};
+
+// Writes to a temporary file next to the new file, which only replaces it in finish(),
+// so an interrupted or cancelled update never leaves a partial new file behind
+class FileSink : public PatchSink
+{
+public:
+	explicit FileSink(const std::filesystem::path& fileName) :
+		fileName{ fileName },
+		temporaryFileName{ std::filesystem::path{ fileName } += ".tmp" },
+		out{ temporaryFileName, std::ofstream::binary }
+	{
+		out.exceptions(out.exceptions() | out.badbit | out.failbit);
+	}
+
+	~FileSink() override
+	{
+		if (out.is_open())
+		{
+			out.close();
+			auto error = std::error_code{};
+			std::filesystem::remove(temporaryFileName, error);
+		}
+	}
+
+	void write(const std::uint8_t* data, std::size_t size) override
+	{
+		out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+	}
+
+	void finish() override
+	{
+		out.close();
+		std::filesystem::rename(temporaryFileName, fileName);
+	}
+
+private:
+	std::filesystem::path fileName;
+	std::filesystem::path temporaryFileName;
+	std::ofstream out;
+};
+
+// std::streambuf forwarding to a PatchSink, so the writers of MappedPatch.hpp can write to it
+class SinkStreamBuffer : public std::streambuf
+{
+public:
+	explicit SinkStreamBuffer(PatchSink& sink) : sink{ &sink } {}
+
+protected:
+	std::streamsize xsputn(const char* data, std::streamsize size) override
+	{
+		sink->write(reinterpret_cast<const std::uint8_t*>(data), static_cast<std::size_t>(size));
+		return size;
+	}
+
+	int_type overflow(int_type character) override
+	{
+		if (traits_type::eq_int_type(character, traits_type::eof()) == false)
+		{
+			auto value = traits_type::to_char_type(character);
+			xsputn(&value, 1);
+		}
+		return traits_type::not_eof(character);
+	}
+
+private:
+	PatchSink* sink;
+};
+
+class PatchCancelled : public std::runtime_error
+{
+public:
+	PatchCancelled() : std::runtime_error{ "Patching has been cancelled" } {}
+};
+
+struct PatchCallbacks
+{
+	// Called regularly with the number of escaped bytes written so far and the expected total
+	std::function<void(std::uint64_t, std::uint64_t)> progress;
+	// Polled as often as progress; applying stops with PatchCancelled when it returns true
+	std::function<bool()> cancelled;
+};
+
+constexpr auto defaultPatchBufferSize = std::size_t{ 4 * 1024 * 1024 };
+
+// Rebuilds the new file of an index file into sink. sources are the old file, followed by the reference files
+// of multi-reference index files, in order; they're validated first when the index file has checksums, and so is the new file.
+inline void applyPatch(IndexFileReader& reader,
+	const std::vector<const PatchSource*>& sources,
+	PatchSink& sink,
+	const PatchCallbacks& callbacks = {},
+	std::size_t bufferSize = defaultPatchBufferSize)
+{
+	const auto& patchData = reader.patchData();
+	const auto& checksums = reader.checksums();
+	if (sources.size() != patchData.referenceFileNames.size() + 1)
+	{
+		throw std::invalid_argument{ "The index file needs " + std::to_string(patchData.referenceFileNames.size() + 1) + " old files" };
+	}
+	auto oldFiles = std::vector<SourceFile>{};
+	for (const auto* source : sources)
+	{
+		auto file = SourceFile{ source->data(), static_cast<std::size_t>(source->size()), {} };
+		if (file.data == nullptr)
+		{
+			file.read = [source](std::size_t offset, std::uint8_t* out, std::size_t count) {
+				source->read(offset, out, count);
+			};
+		}
+		oldFiles.push_back(std::move(file));
+	}
+	if (checksums.has_value())
+	{
+		const auto& oldFile = oldFiles.front();
+		checkOldFile(*checksums, oldFile.size, [&oldFile]() { return hashSourceFile(oldFile); });
+		for (auto i = std::size_t{ 1 }; i < oldFiles.size(); ++i)
+		{
+			const auto& file = oldFiles[i];
+			checkReferenceFile(*checksums, i - 1, file.size, [&file]() { return hashSourceFile(file); });
+		}
+	}
+
+	const auto* columnarChunks = reader.columnarChunks();
+	const auto expected = reader.escapedNewFileSize();
+	auto showProgress = [&callbacks, expected, written = std::uint64_t{ 0 }](std::size_t delta) mutable {
+		written += delta;
+		if (callbacks.cancelled && callbacks.cancelled())
+		{
+			throw PatchCancelled{};
+		}
+		if (callbacks.progress)
+		{
+			callbacks.progress(written, expected);
+		}
+	};
+	auto write = [&](std::ostream& out) {
+		if (columnarChunks != nullptr)
+		{
+			auto cursor = columnarChunks->cursor(0);
+			writeNewFileContentFromChunkSource(out, oldFiles, patchData.escapeData, [&cursor]() { return cursor.next(); }, bufferSize, showProgress);
+			return;
+		}
+		writeNewFileContentFromChunkSource(out, oldFiles, patchData.escapeData, [&reader]() { return reader.nextChunk(); }, bufferSize, showProgress);
+	};
+
+	auto sinkBuffer = SinkStreamBuffer{ sink };
+	if (checksums.has_value())
+	{
+		auto validator = NewFileValidator{ *checksums, 0 };
+		auto validatingBuffer = ValidatingStreamBuffer{ sinkBuffer, validator };
+		auto out = std::ostream{ &validatingBuffer };
+		write(out);
+		if (validator.position() != checksums->newFileSize)
+		{
+			throw std::runtime_error{ "New file is smaller than expected, corrupted index file?" };
+		}
+	}
+	else
+	{
+		auto out = std::ostream{ &sinkBuffer };
+		write(out);
+	}
+	sink.finish();
+}
+
+// Applies an index file like ARPatchApplier: the old files are memory mapped from the directory of the index file,
+// and the new file is written there
+inline void applyPatch(const std::filesystem::path& indexFileName, const PatchCallbacks& callbacks = {}, std::size_t bufferSize = defaultPatchBufferSize)
+{
+	auto reader = IndexFileReader{ indexFileName };
+	const auto directory = indexFileName.parent_path();
+	auto files = std::vector<std::unique_ptr<MappedFileSource>>{};
+	auto sources = std::vector<const PatchSource*>{};
+	files.push_back(std::make_unique<MappedFileSource>(directory / reader.patchData().oldFileName));
+	for (const auto& referenceFileName : reader.patchData().referenceFileNames)
+	{
+		files.push_back(std::make_unique<MappedFileSource>(directory / referenceFileName));
+	}
+	for (const auto& file : files)
+	{
+		sources.push_back(file.get());
+	}
+	auto sink = FileSink{ directory / reader.patchData().newFileName };
+	applyPatch(reader, sources, sink, callbacks, bufferSize);
+}
\ No newline at end of file
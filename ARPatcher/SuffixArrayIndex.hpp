@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <divsufsort.h>
+#include "Mismatch.hpp"
+
+// Uncompressed suffix array with the node interface of the sdsl CSTs used by bestMatch: a node is an interval of the suffix array,
+// child() narrows it with two binary searches, and its depth is the common prefix of its first and last suffixes.
+// The text isn't copied, so it must stay at the same address as long as the index is used.
+class SuffixArrayIndex
+{
+public:
+	struct Node
+	{
+		std::size_t begin;
+		std::size_t end;
+		std::size_t depth;
+
+		bool operator==(const Node& other) const
+		{
+			return begin == other.begin && end == other.end && depth == other.depth;
+		}
+	};
+	using node_type = Node;
+
+	SuffixArrayIndex() = default;
+	// Copies would still point to the text of the original
+	SuffixArrayIndex(const SuffixArrayIndex&) = delete;
+	SuffixArrayIndex& operator=(const SuffixArrayIndex&) = delete;
+	SuffixArrayIndex(SuffixArrayIndex&&) = default;
+	SuffixArrayIndex& operator=(SuffixArrayIndex&&) = default;
+
+	// Named like the CSA of the CSTs, so csa[lb(node)] is the position of a node in the text as well
+	std::vector<saidx_t> csa;
+
+	void build(const std::uint8_t* bytes, std::size_t size)
+	{
+		if (size > static_cast<std::size_t>(std::numeric_limits<saidx_t>::max()))
+		{
+			throw std::length_error{ "The suffix array backend can't index sections larger than 2 GiB" };
+		}
+		text = bytes;
+		textSize = size;
+		csa.resize(size);
+		if (size > 0 && divsufsort(text, csa.data(), static_cast<saidx_t>(size)) != 0)
+		{
+			throw std::runtime_error{ "divsufsort failed" };
+		}
+	}
+
+	Node root() const
+	{
+		return Node{ 0, textSize, 0 };
+	}
+
+	// root() if no suffix of node continues with symbol
+	Node child(const Node& node, std::uint64_t symbol) const
+	{
+		// Suffixes ending at this depth sort first, like the sentinel of the CSTs
+		auto symbolAt = [this, &node](saidx_t suffix) {
+			const auto position = static_cast<std::size_t>(suffix) + node.depth;
+			return position < textSize ? std::int64_t{ text[position] } : std::int64_t{ -1 };
+		};
+		const auto value = static_cast<std::int64_t>(symbol);
+		const auto begin = csa.begin() + node.begin;
+		const auto end = csa.begin() + node.end;
+		const auto first = std::partition_point(begin, end, [&](saidx_t suffix) { return symbolAt(suffix) < value; });
+		const auto last = std::partition_point(first, end, [&](saidx_t suffix) { return symbolAt(suffix) == value; });
+		if (first == last)
+		{
+			return root();
+		}
+
+		auto result = Node{ static_cast<std::size_t>(first - csa.begin()), static_cast<std::size_t>(last - csa.begin()), 0 };
+		if (last - first == 1)
+		{
+			result.depth = textSize - static_cast<std::size_t>(*first);
+			return result;
+		}
+		const auto depth = node.depth + 1;
+		const auto left = static_cast<std::size_t>(*first);
+		const auto right = static_cast<std::size_t>(*std::prev(last));
+		result.depth = depth + mismatchLength(text + left + depth, text + right + depth, textSize - std::max(left, right) - depth);
+		return result;
+	}
+
+	std::size_t lb(const Node& node) const
+	{
+		return node.begin;
+	}
+
+	std::size_t depth(const Node& node) const
+	{
+		return node.depth;
+	}
+
+private:
+	const std::uint8_t* text = nullptr;
+	std::size_t textSize = 0;
+};
\ No newline at end of file
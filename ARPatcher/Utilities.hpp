@@ -2,9 +2,18 @@
 #include <cstdint>
 #include <ratio>
 #include <string>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <istream>
 #include <ostream>
+#include <type_traits>
 #include <fstream>
 #include <filesystem>
+#include <stdexcept>
+#include <vector>
 
 template<typename ValueType>
 std::vector<ValueType> readEntireFile(const std::filesystem::path& path)
@@ -32,6 +41,97 @@ std::vector<ValueType> readEntireFile(const std::filesystem::path& path)
 	return buffer;
 };
 
+// Options are matched case-insensitively and without dashes, so "-cstCache" and "--cst-cache" are the same option
+inline std::string normalizeOptionName(std::string_view name)
+{
+	auto result = std::string{};
+	for (auto character : name)
+	{
+		if (character != '-')
+		{
+			result.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(character))));
+		}
+	}
+	return result;
+}
+
+// Removes "<name> <value>" from the arguments and returns the value
+inline std::optional<std::string> extractOption(std::vector<std::string>& arguments, std::string_view name)
+{
+	auto target = normalizeOptionName(name);
+	auto found = std::find_if(arguments.begin(), arguments.end(), [&target](const std::string& argument) {
+		return argument.size() > 1 && argument.front() == '-' && normalizeOptionName(argument) == target;
+	});
+	if (found == arguments.end())
+	{
+		return std::nullopt;
+	}
+	if (std::next(found) == arguments.end())
+	{
+		throw std::invalid_argument{ "Missing value for option " + std::string{ name } };
+	}
+	auto value = *std::next(found);
+	arguments.erase(found, std::next(found, 2));
+	return value;
+}
+
+// Removes "<name>" from the arguments and returns whether it was present
+inline bool extractFlag(std::vector<std::string>& arguments, std::string_view name)
+{
+	auto target = normalizeOptionName(name);
+	auto found = std::find_if(arguments.begin(), arguments.end(), [&target](const std::string& argument) {
+		return argument.size() > 1 && argument.front() == '-' && normalizeOptionName(argument) == target;
+	});
+	if (found == arguments.end())
+	{
+		return false;
+	}
+	arguments.erase(found);
+	return true;
+}
+
+
+// Fixed size little endian integers, for binary files which have to be portable
+template<typename Integer>
+void writeLittleEndian(std::ostream& out, Integer value)
+{
+	static_assert(std::is_integral_v<Integer>);
+	char bytes[sizeof(Integer)];
+	for (auto i = std::size_t{ 0 }; i < sizeof(Integer); ++i)
+	{
+		bytes[i] = static_cast<char>(static_cast<std::make_unsigned_t<Integer>>(value) >> (i * 8) & 0xFF);
+	}
+	out.write(bytes, sizeof(Integer));
+}
+
+template<typename Integer>
+Integer readLittleEndian(std::istream& in)
+{
+	static_assert(std::is_integral_v<Integer>);
+	unsigned char bytes[sizeof(Integer)];
+	if (in.read(reinterpret_cast<char*>(bytes), sizeof(Integer)).gcount() != sizeof(Integer))
+	{
+		throw std::runtime_error{ "Unexpected end of file" };
+	}
+	auto value = std::make_unsigned_t<Integer>{ 0 };
+	for (auto i = sizeof(Integer); i-- > 0;)
+	{
+		value = static_cast<std::make_unsigned_t<Integer>>(value << 8 | bytes[i]);
+	}
+	return static_cast<Integer>(value);
+}
+
+template<typename Integer>
+Integer loadLittleEndian(const std::uint8_t* bytes)
+{
+	static_assert(std::is_integral_v<Integer>);
+	auto value = std::make_unsigned_t<Integer>{ 0 };
+	for (auto i = sizeof(Integer); i-- > 0;)
+	{
+		value = static_cast<std::make_unsigned_t<Integer>>(value << 8 | bytes[i]);
+	}
+	return static_cast<Integer>(value);
+}
 
 template<typename N>
 struct Suffix {
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <filesystem>
+#include <PatchData.hpp>
+#include <Escape.hpp>
+
+// DataChunk with 64 bit lengths and source positions, so files can be larger than 4 GiB.
+// Chunks are kept in this form everywhere; ARPatcherData's DataChunk is only used to read and write index files in the PatchData format.
+struct WideDataChunk
+{
+	static constexpr std::size_t lowestReferencedBytesCount = DataChunk::lowestReferencedBytesCount;
+
+	WideDataChunk(std::uint64_t length, std::uint64_t sourcePosition, std::vector<std::uint8_t> data) :
+		length{ length },
+		sourcePosition{ sourcePosition },
+		data{ std::move(data) }
+	{}
+
+	std::uint64_t length;
+	// uint64_t(-1) for literal chunks
+	std::uint64_t sourcePosition;
+	std::vector<std::uint8_t> data;
+};
+
+struct WidePatchData
+{
+	std::filesystem::path oldFileName;
+	std::filesystem::path newFileName;
+	EscapeData escapeData;
+	std::vector<WideDataChunk> dataChunks;
+	// Additional old files of multi-reference index files. Copy chunks address the concatenation
+	// of the escaped old file and of these files, in order, as if they were a single old file.
+	std::vector<std::filesystem::path> referenceFileNames;
+};
+
+// Literal chunks have the largest source position of their width, for DataChunk and WideDataChunk alike
+template<typename Chunk>
+bool isLiteralChunk(const Chunk& chunk)
+{
+	return chunk.sourcePosition == static_cast<decltype(chunk.sourcePosition)>(-1);
+}
+
+// Whether the chunks can be stored in the 32 bit fields of DataChunk
+inline bool fitsInPatchData(const WidePatchData& patchData)
+{
+	constexpr auto limit = std::uint64_t{ std::numeric_limits<std::uint32_t>::max() };
+	for (const auto& chunk : patchData.dataChunks)
+	{
+		if (chunk.length > limit || (isLiteralChunk(chunk) == false && chunk.sourcePosition >= limit))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline WidePatchData toWidePatchData(PatchData patchData)
+{
+	auto result = WidePatchData{ std::move(patchData.oldFileName), std::move(patchData.newFileName), patchData.escapeData, {} };
+	result.dataChunks.reserve(patchData.dataChunks.size());
+	for (auto& chunk : patchData.dataChunks)
+	{
+		auto sourcePosition = isLiteralChunk(chunk) ? static_cast<std::uint64_t>(-1) : std::uint64_t{ chunk.sourcePosition };
+		result.dataChunks.emplace_back(chunk.length, sourcePosition, std::move(chunk.data));
+	}
+	return result;
+}
+
+// Throws std::length_error if the chunks don't fit in DataChunk
+inline PatchData toPatchData(WidePatchData patchData)
+{
+	if (fitsInPatchData(patchData) == false)
+	{
+		throw std::length_error{ "Files larger than 4 GiB can't be stored in the PatchData format" };
+	}
+	auto chunks = std::vector<DataChunk>{};
+	chunks.reserve(patchData.dataChunks.size());
+	for (auto& chunk : patchData.dataChunks)
+	{
+		auto sourcePosition = isLiteralChunk(chunk) ? static_cast<std::uint32_t>(-1) : static_cast<std::uint32_t>(chunk.sourcePosition);
+		chunks.emplace_back(static_cast<std::uint32_t>(chunk.length), sourcePosition, std::move(chunk.data));
+	}
+	return PatchData{ latestPatchDataVersion, std::move(patchData.oldFileName), std::move(patchData.newFileName), patchData.escapeData, std::move(chunks) };
+}
\ No newline at end of file
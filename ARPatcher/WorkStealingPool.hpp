@@ -0,0 +1,163 @@
+#pragma once
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+// Runs a batch of indexed tasks on a fixed number of threads.
+// Every worker starts with a contiguous block of task indices (so neighbouring tasks stay on the same thread),
+// takes tasks from the front of its own queue, and steals from the back of the other queues once its own is empty.
+class WorkStealingPool
+{
+public:
+	explicit WorkStealingPool(std::size_t threadCount) :
+		threadCount{ threadCount == 0 ? std::max<std::size_t>(1, std::thread::hardware_concurrency()) : threadCount }
+	{}
+
+	std::size_t size() const
+	{
+		return threadCount;
+	}
+
+	// Calls task(taskIndex, workerIndex) for every taskIndex in [0, taskCount) and waits for all of them.
+	// If any task throws, remaining tasks are abandoned and the first exception is rethrown.
+	template<typename Task>
+	void run(std::size_t taskCount, Task task)
+	{
+		auto queues = std::vector<Queue>(threadCount);
+		for (auto i = std::size_t{ 0 }; i < taskCount; ++i)
+		{
+			queues.at(i * threadCount / taskCount).tasks.push_back(i);
+		}
+
+		auto errorMutex = std::mutex{};
+		auto error = std::exception_ptr{};
+		auto failed = std::atomic<bool>{ false };
+
+		auto work = [&](std::size_t workerIndex) {
+			try
+			{
+				while (true)
+				{
+					if (failed)
+					{
+						return;
+					}
+					auto next = takeOwn(queues.at(workerIndex));
+					for (auto offset = std::size_t{ 1 }; next.has_value() == false && offset < threadCount; ++offset)
+					{
+						next = steal(queues.at((workerIndex + offset) % threadCount));
+					}
+					if (next.has_value() == false)
+					{
+						return;
+					}
+					task(*next, workerIndex);
+				}
+			}
+			catch (...)
+			{
+				auto lock = std::lock_guard{ errorMutex };
+				if (error == nullptr)
+				{
+					error = std::current_exception();
+				}
+				failed = true;
+			}
+		};
+
+		auto threads = std::vector<std::thread>{};
+		for (auto i = std::size_t{ 1 }; i < threadCount; ++i)
+		{
+			threads.emplace_back(work, i);
+		}
+		work(0);
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::size_t> tasks;
+	};
+
+	static std::optional<std::size_t> takeOwn(Queue& queue)
+	{
+		auto lock = std::lock_guard{ queue.mutex };
+		if (queue.tasks.empty())
+		{
+			return std::nullopt;
+		}
+		auto task = queue.tasks.front();
+		queue.tasks.pop_front();
+		return task;
+	}
+
+	static std::optional<std::size_t> steal(Queue& queue)
+	{
+		auto lock = std::lock_guard{ queue.mutex };
+		if (queue.tasks.empty())
+		{
+			return std::nullopt;
+		}
+		auto task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return task;
+	}
+
+	std::size_t threadCount;
+};
+
+// Lets at most limit threads run a part of their tasks at the same time, for example the one needing the most memory
+class ConcurrencyLimit
+{
+public:
+	explicit ConcurrencyLimit(std::size_t limit) : available{ std::max<std::size_t>(limit, 1) } {}
+
+	// Waits until fewer than limit threads are in run(), then returns part()
+	template<typename Part>
+	auto run(Part part)
+	{
+		{
+			auto lock = std::unique_lock{ mutex };
+			changed.wait(lock, [this]() { return available > 0; });
+			--available;
+		}
+		// Also released when part() throws
+		struct Release
+		{
+			ConcurrencyLimit* limit;
+
+			~Release()
+			{
+				{
+					auto lock = std::lock_guard{ limit->mutex };
+					++limit->available;
+				}
+				limit->changed.notify_one();
+			}
+		};
+		const auto release = Release{ this };
+		return part();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::size_t available;
+};
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <filesystem>
+#include <stdexcept>
+
+#include "StreamingPatch.hpp"
+#include "Launcher.hpp"
+
+bool updateFile(const std::filesystem::path& indexFileName)
+{
+	auto callbacks = PatchCallbacks{};
+	callbacks.progress = [](std::uint64_t written, std::uint64_t expected) {
+		std::cerr << "Updating... " << makePercent(written, expected) << "\r";
+	};
+	try
+	{
+		applyPatch(indexFileName, callbacks);
+	}
+	catch (const std::runtime_error& error)
+	{
+		std::cerr << "Update failed: " << error.what() << std::endl;
+		return false;
+	}
+	std::cerr << "Updated with " << indexFileName << std::endl;
+	return true;
+}
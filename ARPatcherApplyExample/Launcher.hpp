@@ -0,0 +1,5 @@
+#pragma once
+#include <filesystem>
+
+// Applies an index file to the old file next to it, printing the progress; false if the old file isn't the expected one
+bool updateFile(const std::filesystem::path& indexFileName);
@@ -0,0 +1,28 @@
+#include <iostream>
+#include <filesystem>
+
+#include "StreamingPatch.hpp"
+#include "Launcher.hpp"
+
+// Example of a program applying index files with the ARPatcherApply library, from two translation units
+// which both include StreamingPatch.hpp
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: ARPatcherApplyExample <index file name>..." << std::endl;
+		return 1;
+	}
+	for (auto i = 1; i < argc; ++i)
+	{
+		{
+			auto reader = IndexFileReader{ argv[i] };
+			std::cerr << "Updating " << reader.patchData().oldFileName << " to " << reader.patchData().newFileName << std::endl;
+		}
+		if (updateFile(argv[i]) == false)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
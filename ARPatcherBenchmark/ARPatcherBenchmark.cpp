@@ -0,0 +1,323 @@
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+
+#include "Utilities.hpp"
+#include "Hash.hpp"
+#include "ChildProcess.hpp"
+#include "CorpusGenerator.hpp"
+
+namespace filesystem = std::filesystem;
+
+void printUsage()
+{
+	std::cerr << "Usage: " << std::endl;
+	std::cerr << "Measure ARPatcher on synthetic new files derived from a base file:\n"
+		<< "ARPatcherBenchmark <base file name> <work directory> [options] [-- <extra ARPatcher -generateIndexFile options>]\n"
+		<< "Options:\n"
+		<< "-scenario <name>:<inserts>,<deletes>,<byte flips>,<block moves>: add a scenario (can be repeated);\n"
+		<< "\twithout it, a default set of scenarios is used\n"
+		<< "-seed <number>: seed of the corpus generator (default 1)\n"
+		<< "-maxEditSize <bytes>: maximum size of inserted, deleted and moved blocks (default 4096)\n"
+		<< "-maxSingleBufferSize <MiB>: passed to ARPatcher -generateIndexFile (default 0, no limit)\n"
+		<< "-minimumChunkFactor <factor>: passed to ARPatcher -generateIndexFile (default 0.000001)\n"
+		<< "-lowBufferSize <bytes>: buffer size of ARPatcher -buildNewFileLow (default 16777216)\n"
+		<< "-tools <directory>: directory of the ARPatcher executable (default: the directory of ARPatcherBenchmark)\n"
+		<< "-csv <file name>: also write the results to a CSV file\n\n";
+	std::cerr << "Only write a synthetic new file:\n"
+		<< "ARPatcherBenchmark -generateCorpus <base file name> <output file name> <inserts> <deletes> <byte flips> <block moves>\n"
+		<< "\t[-seed <number>] [-maxEditSize <bytes>]\n\n";
+	std::cerr << "Every result is measured on a separate ARPatcher process: wall time, and peak resident set size (peak working set on Windows).\n";
+	std::cerr << std::endl;
+}
+
+std::vector<CorpusMutations> defaultScenarios()
+{
+	return {
+		CorpusMutations{ "edits", 64, 64, 0, 0 },
+		CorpusMutations{ "flips", 0, 0, 4096, 0 },
+		CorpusMutations{ "moves", 0, 0, 0, 32 },
+		CorpusMutations{ "mixed", 32, 32, 1024, 16 },
+	};
+}
+
+// "<name>:<inserts>,<deletes>,<byte flips>,<block moves>"
+CorpusMutations parseScenario(const std::string& description)
+{
+	auto separator = description.find(':');
+	if (separator == std::string::npos || separator == 0)
+	{
+		throw std::invalid_argument{ "Invalid scenario " + description };
+	}
+	auto result = CorpusMutations{};
+	result.name = description.substr(0, separator);
+	auto counts = std::istringstream{ description.substr(separator + 1) };
+	auto comma = char{};
+	if ((counts >> result.inserts >> comma >> result.deletes >> comma >> result.byteFlips >> comma >> result.blockMoves).fail())
+	{
+		throw std::invalid_argument{ "Invalid scenario " + description };
+	}
+	return result;
+}
+
+struct StepResult
+{
+	ProcessResult process;
+	bool correct = false;
+};
+
+struct ScenarioResult
+{
+	std::string name;
+	std::uint64_t newFileSize = 0;
+	ProcessResult generate;
+	std::optional<double> cstSeconds;
+	std::uint64_t indexFileSize = 0;
+	StepResult buildNewFile;
+	StepResult buildNewFileLow;
+};
+
+// Parsed from the "CST construction time: <seconds> s" line of ARPatcher
+std::optional<double> findCstConstructionTime(const filesystem::path& logFileName)
+{
+	constexpr auto prefix = std::string_view{ "CST construction time: " };
+	auto log = std::ifstream{ logFileName };
+	auto line = std::string{};
+	while (std::getline(log, line))
+	{
+		auto found = line.find(prefix);
+		if (found != std::string::npos)
+		{
+			return std::stod(line.substr(found + prefix.size()));
+		}
+	}
+	return std::nullopt;
+}
+
+std::uint64_t hashFile(const filesystem::path& path)
+{
+	auto input = std::ifstream{ path, std::ifstream::binary };
+	auto hash = XXHash64{};
+	auto buffer = std::vector<char>(1024 * 1024);
+	while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)
+	{
+		hash.update(buffer.data(), static_cast<std::size_t>(input.gcount()));
+	}
+	return hash.digest();
+}
+
+double throughput(std::uint64_t bytes, double seconds)
+{
+	return seconds > 0 ? bytes / evaluateRatio<std::mega, double>() / seconds : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		auto arguments = std::vector<std::string>{ argv + 1, argv + argc };
+		auto extraGenerateArguments = std::vector<std::string>{};
+		auto separator = std::find(arguments.begin(), arguments.end(), "--");
+		if (separator != arguments.end())
+		{
+			extraGenerateArguments.assign(std::next(separator), arguments.end());
+			arguments.erase(separator, arguments.end());
+		}
+
+		auto mutationsTemplate = CorpusMutations{};
+		if (auto seed = extractOption(arguments, "-seed"))
+		{
+			mutationsTemplate.seed = std::stoull(*seed);
+		}
+		if (auto maxEditSize = extractOption(arguments, "-maxEditSize"))
+		{
+			mutationsTemplate.maxEditSize = std::stoul(*maxEditSize);
+		}
+
+		if (arguments.empty() == false && normalizeOptionName(arguments.front()) == "generatecorpus")
+		{
+			if (arguments.size() != 7)
+			{
+				printUsage();
+				return 1;
+			}
+			auto mutations = mutationsTemplate;
+			mutations.inserts = std::stoul(arguments.at(3));
+			mutations.deletes = std::stoul(arguments.at(4));
+			mutations.byteFlips = std::stoul(arguments.at(5));
+			mutations.blockMoves = std::stoul(arguments.at(6));
+			auto newFile = generateCorpusFile(readEntireFile<std::uint8_t>(arguments.at(1)), mutations);
+			auto output = std::ofstream{ arguments.at(2), std::ofstream::binary };
+			output.exceptions(output.exceptions() | output.badbit | output.failbit);
+			output.write(reinterpret_cast<const char*>(newFile.data()), newFile.size());
+			std::cerr << "Corpus file written to " << arguments.at(2) << " (" << makeMetricPrefix(newFile.size()) << "B)" << std::endl;
+			return 0;
+		}
+
+		auto scenarios = std::vector<CorpusMutations>{};
+		while (auto scenario = extractOption(arguments, "-scenario"))
+		{
+			scenarios.push_back(parseScenario(*scenario));
+		}
+		if (scenarios.empty())
+		{
+			scenarios = defaultScenarios();
+		}
+		auto maxSingleBufferSize = extractOption(arguments, "-maxSingleBufferSize").value_or("0");
+		auto minimumChunkFactor = extractOption(arguments, "-minimumChunkFactor").value_or("0.000001");
+		auto lowBufferSize = extractOption(arguments, "-lowBufferSize").value_or("16777216");
+		auto toolsDirectory = filesystem::absolute(argv[0]).parent_path();
+		if (auto tools = extractOption(arguments, "-tools"))
+		{
+			toolsDirectory = filesystem::absolute(*tools);
+		}
+		auto csvFileName = extractOption(arguments, "-csv");
+		if (arguments.size() != 2)
+		{
+			printUsage();
+			return 1;
+		}
+
+		const auto patcher = toolsDirectory / (std::string{ "ARPatcher" } + executableSuffix);
+		const auto workDirectory = filesystem::absolute(arguments.at(1));
+		filesystem::create_directories(workDirectory);
+		const auto oldFileName = std::string{ "base.old" };
+		filesystem::copy_file(arguments.at(0), workDirectory / oldFileName, filesystem::copy_options::overwrite_existing);
+		const auto base = readEntireFile<std::uint8_t>(workDirectory / oldFileName);
+
+		auto results = std::vector<ScenarioResult>{};
+		for (auto mutations : scenarios)
+		{
+			mutations.seed = mutationsTemplate.seed;
+			mutations.maxEditSize = mutationsTemplate.maxEditSize;
+			std::cerr << "Scenario " << mutations.name << ": " << mutations.inserts << " inserts, " << mutations.deletes << " deletes, "
+				<< mutations.byteFlips << " byte flips, " << mutations.blockMoves << " block moves" << std::endl;
+
+			auto result = ScenarioResult{};
+			result.name = mutations.name;
+			const auto newFileName = mutations.name + ".new";
+			const auto indexFileName = mutations.name + ".idx";
+			auto expectedHash = std::uint64_t{};
+			{
+				const auto newFile = generateCorpusFile(base, mutations);
+				result.newFileSize = newFile.size();
+				expectedHash = hash64(newFile);
+				auto output = std::ofstream{ workDirectory / newFileName, std::ofstream::binary };
+				output.exceptions(output.exceptions() | output.badbit | output.failbit);
+				output.write(reinterpret_cast<const char*>(newFile.data()), newFile.size());
+			}
+
+			auto generateArguments = std::vector<std::string>{ "-generateIndexFile", oldFileName, newFileName, indexFileName, maxSingleBufferSize, minimumChunkFactor };
+			generateArguments.insert(generateArguments.end(), extraGenerateArguments.begin(), extraGenerateArguments.end());
+			const auto generateLog = workDirectory / (mutations.name + ".generate.log");
+			result.generate = runProcess(patcher, generateArguments, workDirectory, generateLog);
+			if (result.generate.exitCode != 0)
+			{
+				throw std::runtime_error{ "ARPatcher -generateIndexFile failed, see " + generateLog.string() };
+			}
+			result.cstSeconds = findCstConstructionTime(generateLog);
+			result.indexFileSize = filesystem::file_size(workDirectory / indexFileName);
+
+			// Both modes overwrite the new file, which is then compared with the generated one
+			auto build = [&](const std::vector<std::string>& buildArguments) {
+				auto step = StepResult{};
+				filesystem::remove(workDirectory / newFileName);
+				const auto log = workDirectory / (mutations.name + "." + buildArguments.front().substr(1) + ".log");
+				step.process = runProcess(patcher, buildArguments, workDirectory, log);
+				step.correct = step.process.exitCode == 0 && filesystem::exists(workDirectory / newFileName)
+					&& filesystem::file_size(workDirectory / newFileName) == result.newFileSize && hashFile(workDirectory / newFileName) == expectedHash;
+				return step;
+			};
+			result.buildNewFile = build({ "-buildNewFile", indexFileName });
+			result.buildNewFileLow = build({ "-buildNewFileLow", indexFileName, lowBufferSize });
+			results.push_back(result);
+		}
+
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "Base file: " << arguments.at(0) << " (" << makeMetricPrefix(base.size()) << "B)\n"
+			<< std::left << std::setw(12) << "scenario"
+			<< std::right << std::setw(12) << "new size"
+			<< std::setw(14) << "gen MB/s" << std::setw(12) << "gen RSS"
+			<< std::setw(10) << "CST s"
+			<< std::setw(12) << "index size"
+			<< std::setw(14) << "build MB/s" << std::setw(12) << "build RSS"
+			<< std::setw(14) << "low MB/s" << std::setw(12) << "low RSS" << '\n';
+		auto formatSize = [](std::uint64_t size) {
+			auto text = std::ostringstream{};
+			text << std::fixed << std::setprecision(2) << makeMetricPrefix(size) << 'B';
+			return text.str();
+		};
+		for (const auto& result : results)
+		{
+			auto stepThroughput = [&result](const StepResult& step) {
+				auto text = std::ostringstream{};
+				text << std::fixed << std::setprecision(2);
+				if (step.correct)
+				{
+					text << throughput(result.newFileSize, step.process.seconds);
+				}
+				else
+				{
+					text << "FAILED";
+				}
+				return text.str();
+			};
+			auto cstSeconds = std::ostringstream{};
+			cstSeconds << std::fixed << std::setprecision(2);
+			if (result.cstSeconds.has_value())
+			{
+				cstSeconds << *result.cstSeconds;
+			}
+			else
+			{
+				cstSeconds << "-";
+			}
+			std::cout << std::left << std::setw(12) << result.name
+				<< std::right << std::setw(12) << formatSize(result.newFileSize)
+				<< std::setw(14) << throughput(result.newFileSize, result.generate.seconds) << std::setw(12) << formatSize(result.generate.peakMemory)
+				<< std::setw(10) << cstSeconds.str()
+				<< std::setw(12) << formatSize(result.indexFileSize)
+				<< std::setw(14) << stepThroughput(result.buildNewFile) << std::setw(12) << formatSize(result.buildNewFile.process.peakMemory)
+				<< std::setw(14) << stepThroughput(result.buildNewFileLow) << std::setw(12) << formatSize(result.buildNewFileLow.process.peakMemory) << '\n';
+		}
+
+		if (csvFileName.has_value())
+		{
+			auto csv = std::ofstream{ *csvFileName };
+			csv.exceptions(csv.exceptions() | csv.badbit | csv.failbit);
+			csv << "scenario,new file bytes,generate seconds,generate peak bytes,cst seconds,index file bytes,"
+				<< "buildNewFile seconds,buildNewFile peak bytes,buildNewFile correct,"
+				<< "buildNewFileLow seconds,buildNewFileLow peak bytes,buildNewFileLow correct\n";
+			for (const auto& result : results)
+			{
+				csv << result.name << ',' << result.newFileSize << ','
+					<< result.generate.seconds << ',' << result.generate.peakMemory << ','
+					<< (result.cstSeconds.has_value() ? std::to_string(*result.cstSeconds) : std::string{}) << ','
+					<< result.indexFileSize << ',';
+				for (const auto* step : { &result.buildNewFile, &result.buildNewFileLow })
+				{
+					csv << step->process.seconds << ',' << step->process.peakMemory << ',' << (step->correct ? "true" : "false");
+					csv << (step == &result.buildNewFileLow ? '\n' : ',');
+				}
+			}
+			std::cerr << "Results written to " << *csvFileName << std::endl;
+		}
+
+		auto failed = std::any_of(results.begin(), results.end(), [](const ScenarioResult& result) {
+			return result.buildNewFile.correct == false || result.buildNewFileLow.correct == false;
+		});
+		return failed ? 2 : 0;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+}
\ No newline at end of file
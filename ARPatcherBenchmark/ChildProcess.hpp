@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <filesystem>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+constexpr auto executableSuffix = ".exe";
+#else
+constexpr auto executableSuffix = "";
+#endif
+
+struct ProcessResult
+{
+	int exitCode = -1;
+	double seconds = 0;
+	// Peak resident set size (peak working set on Windows) in bytes
+	std::uint64_t peakMemory = 0;
+};
+
+// Runs a program to completion in workingDirectory, with standard output and error redirected to logFileName
+// and no standard input, and measures its wall time and peak memory usage
+inline ProcessResult runProcess(const std::filesystem::path& executable,
+	const std::vector<std::string>& arguments,
+	const std::filesystem::path& workingDirectory,
+	const std::filesystem::path& logFileName)
+{
+	auto result = ProcessResult{};
+#ifdef _WIN32
+	auto commandLine = L"\"" + executable.wstring() + L"\"";
+	for (const auto& argument : arguments)
+	{
+		commandLine += L" \"" + std::filesystem::u8path(argument).wstring() + L"\"";
+	}
+	auto security = SECURITY_ATTRIBUTES{ sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+	auto log = CreateFileW(logFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &security, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	auto input = CreateFileW(L"NUL", GENERIC_READ, 0, &security, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (log == INVALID_HANDLE_VALUE || input == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error{ "Failed to create " + logFileName.string() };
+	}
+	auto startup = STARTUPINFOW{};
+	startup.cb = sizeof(startup);
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = input;
+	startup.hStdOutput = log;
+	startup.hStdError = log;
+	auto process = PROCESS_INFORMATION{};
+	const auto begin = std::chrono::steady_clock::now();
+	auto created = CreateProcessW(executable.c_str(), commandLine.data(), nullptr, nullptr, TRUE, 0, nullptr, workingDirectory.c_str(), &startup, &process);
+	CloseHandle(log);
+	CloseHandle(input);
+	if (created == FALSE)
+	{
+		throw std::runtime_error{ "Failed to start " + executable.string() };
+	}
+	WaitForSingleObject(process.hProcess, INFINITE);
+	result.seconds = std::chrono::duration<double>{ std::chrono::steady_clock::now() - begin }.count();
+	auto exitCode = DWORD{ 0 };
+	GetExitCodeProcess(process.hProcess, &exitCode);
+	result.exitCode = static_cast<int>(exitCode);
+	auto counters = PROCESS_MEMORY_COUNTERS{};
+	if (GetProcessMemoryInfo(process.hProcess, &counters, sizeof(counters)) != FALSE)
+	{
+		result.peakMemory = counters.PeakWorkingSetSize;
+	}
+	CloseHandle(process.hThread);
+	CloseHandle(process.hProcess);
+#else
+	auto argv = std::vector<char*>{};
+	auto executableName = executable.string();
+	argv.push_back(executableName.data());
+	auto argumentCopies = arguments;
+	for (auto& argument : argumentCopies)
+	{
+		argv.push_back(argument.data());
+	}
+	argv.push_back(nullptr);
+
+	const auto begin = std::chrono::steady_clock::now();
+	auto child = ::fork();
+	if (child == -1)
+	{
+		throw std::runtime_error{ "Failed to start " + executableName };
+	}
+	if (child == 0)
+	{
+		auto log = ::open(logFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		auto input = ::open("/dev/null", O_RDONLY);
+		if (log == -1 || input == -1 || ::chdir(workingDirectory.c_str()) != 0)
+		{
+			::_exit(127);
+		}
+		::dup2(input, STDIN_FILENO);
+		::dup2(log, STDOUT_FILENO);
+		::dup2(log, STDERR_FILENO);
+		::execv(argv[0], argv.data());
+		::_exit(127);
+	}
+	auto status = 0;
+	auto usage = rusage{};
+	if (::wait4(child, &status, 0, &usage) == -1)
+	{
+		throw std::runtime_error{ "Failed to wait for " + executableName };
+	}
+	result.seconds = std::chrono::duration<double>{ std::chrono::steady_clock::now() - begin }.count();
+	result.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#ifdef __APPLE__
+	result.peakMemory = static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+	result.peakMemory = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	return result;
+}
\ No newline at end of file
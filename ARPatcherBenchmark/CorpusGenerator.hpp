@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// How a synthetic new file is derived from a base file
+struct CorpusMutations
+{
+	std::string name;
+	std::size_t inserts = 0;
+	std::size_t deletes = 0;
+	std::size_t byteFlips = 0;
+	std::size_t blockMoves = 0;
+	// Inserted, deleted and moved blocks are 1 to maxEditSize bytes long
+	std::size_t maxEditSize = 4096;
+	std::uint64_t seed = 1;
+};
+
+// Applies the mutations in a shuffled order. The result only depends on the base file and the mutations:
+// the random numbers come from std::mt19937_64, whose sequence is fixed by the standard, and are mapped to ranges by hand
+// (unlike the standard distributions, which may differ between library implementations).
+inline std::vector<std::uint8_t> generateCorpusFile(std::vector<std::uint8_t> file, const CorpusMutations& mutations)
+{
+	enum class Operation
+	{
+		insert,
+		erase,
+		flip,
+		move
+	};
+
+	auto engine = std::mt19937_64{ mutations.seed };
+	auto below = [&engine](std::size_t limit) {
+		return limit == 0 ? std::size_t{ 0 } : static_cast<std::size_t>(engine() % limit);
+	};
+	auto editSize = [&below, &mutations]() {
+		return below(std::max<std::size_t>(mutations.maxEditSize, 1)) + 1;
+	};
+
+	auto operations = std::vector<Operation>{};
+	operations.insert(operations.end(), mutations.inserts, Operation::insert);
+	operations.insert(operations.end(), mutations.deletes, Operation::erase);
+	operations.insert(operations.end(), mutations.byteFlips, Operation::flip);
+	operations.insert(operations.end(), mutations.blockMoves, Operation::move);
+	for (auto i = operations.size(); i > 1; --i)
+	{
+		std::swap(operations[i - 1], operations[below(i)]);
+	}
+
+	for (auto operation : operations)
+	{
+		switch (operation)
+		{
+		case Operation::insert:
+		{
+			auto position = below(file.size() + 1);
+			auto block = std::vector<std::uint8_t>(editSize());
+			for (auto& byte : block)
+			{
+				byte = static_cast<std::uint8_t>(engine());
+			}
+			file.insert(file.begin() + position, block.begin(), block.end());
+			break;
+		}
+		case Operation::erase:
+		{
+			auto position = below(file.size());
+			auto length = std::min(editSize(), file.size() - position);
+			file.erase(file.begin() + position, file.begin() + position + length);
+			break;
+		}
+		case Operation::flip:
+			if (file.empty() == false)
+			{
+				file[below(file.size())] ^= static_cast<std::uint8_t>(below(255) + 1);
+			}
+			break;
+		case Operation::move:
+		{
+			auto position = below(file.size());
+			auto length = std::min(editSize(), file.size() - position);
+			auto block = std::vector<std::uint8_t>(file.begin() + position, file.begin() + position + length);
+			file.erase(file.begin() + position, file.begin() + position + length);
+			auto destination = below(file.size() + 1);
+			file.insert(file.begin() + destination, block.begin(), block.end());
+			break;
+		}
+		}
+	}
+	return file;
+}
\ No newline at end of file